@@ -0,0 +1,561 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+// Benchmarks parsing, flattening, stroking and filling on reproducible
+// synthetic corpora, sample icon paths and optionally given svg files.
+// Measures throughput, allocations per call and peak memory and writes
+// the results as json so they can be compared across versions.
+// Usage: ktc-bench [--json <file>] [--quick] [--filter <str>] [<file.svg>...]
+
+#include <katachi/svg.hpp>
+#include <katachi/svgDocument.hpp>
+#include <katachi/mappedFile.hpp>
+#include <katachi/path.hpp>
+#include <katachi/stroke.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <sys/resource.h>
+	#define KTC_BENCH_RUSAGE
+#endif
+
+#ifndef KTC_VERSION
+	#define KTC_VERSION "unknown"
+#endif
+
+// Allocation tracking.
+// All allocations of the process (including the ones inside katachi and
+// the ones of the default pmr resource) go through the replaced global
+// operator new. Each allocation stores its size and the start of the
+// underlying malloc allocation in front of the returned memory.
+namespace {
+
+struct AllocHeader {
+	std::size_t size;
+	void* base;
+};
+
+std::atomic<std::uint64_t> allocCount {};
+std::atomic<std::uint64_t> allocBytes {};
+std::atomic<std::int64_t> heapBytes {};
+std::atomic<std::int64_t> heapPeak {};
+
+void* trackedAlloc(std::size_t size,
+		std::size_t alignment = alignof(std::max_align_t)) noexcept {
+	alignment = std::max(alignment, alignof(AllocHeader));
+	auto base = std::malloc(size + sizeof(AllocHeader) + alignment);
+	if(!base) {
+		return nullptr;
+	}
+
+	auto addr = reinterpret_cast<std::uintptr_t>(base) + sizeof(AllocHeader);
+	addr = (addr + alignment - 1) & ~std::uintptr_t(alignment - 1);
+	auto ptr = reinterpret_cast<void*>(addr);
+	auto header = AllocHeader {size, base};
+	std::memcpy(static_cast<char*>(ptr) - sizeof(header), &header,
+		sizeof(header));
+
+	++allocCount;
+	allocBytes += size;
+	auto current = (heapBytes += std::int64_t(size));
+	auto peak = heapPeak.load();
+	while(current > peak && !heapPeak.compare_exchange_weak(peak, current));
+	return ptr;
+}
+
+void trackedFree(void* ptr) noexcept {
+	if(!ptr) {
+		return;
+	}
+
+	AllocHeader header;
+	std::memcpy(&header, static_cast<char*>(ptr) - sizeof(header),
+		sizeof(header));
+	heapBytes -= std::int64_t(header.size);
+	std::free(header.base);
+}
+
+void* trackedNew(std::size_t size,
+		std::size_t alignment = alignof(std::max_align_t)) {
+	if(auto ptr = trackedAlloc(size, alignment)) {
+		return ptr;
+	}
+
+	throw std::bad_alloc();
+}
+
+} // anon namespace
+
+using std::size_t;
+using std::align_val_t;
+using std::nothrow_t;
+
+void* operator new(size_t size) { return trackedNew(size); }
+void* operator new[](size_t size) { return trackedNew(size); }
+void* operator new(size_t size, const nothrow_t&) noexcept {
+	return trackedAlloc(size);
+}
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+	return trackedAlloc(size);
+}
+void* operator new(size_t size, align_val_t align) {
+	return trackedNew(size, size_t(align));
+}
+void* operator new[](size_t size, align_val_t align) {
+	return trackedNew(size, size_t(align));
+}
+void* operator new(size_t size, align_val_t align, const nothrow_t&) noexcept {
+	return trackedAlloc(size, size_t(align));
+}
+void* operator new[](size_t size, align_val_t align, const nothrow_t&) noexcept {
+	return trackedAlloc(size, size_t(align));
+}
+
+void operator delete(void* ptr) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, const nothrow_t&) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, const nothrow_t&) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, align_val_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, align_val_t) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, size_t, align_val_t) noexcept { trackedFree(ptr); }
+void operator delete[](void* ptr, size_t, align_val_t) noexcept { trackedFree(ptr); }
+void operator delete(void* ptr, align_val_t, const nothrow_t&) noexcept {
+	trackedFree(ptr);
+}
+void operator delete[](void* ptr, align_val_t, const nothrow_t&) noexcept {
+	trackedFree(ptr);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Sample paths in the style of common ui icons (24x24 grid).
+constexpr const char* iconPaths[] = {
+	// heart
+	"M12 21.35l-1.45-1.32C5.4 15.36 2 12.28 2 8.5 2 5.42 4.42 3 7.5 3c1.74 "
+	"0 3.41.81 4.5 2.09C13.09 3.81 14.76 3 16.5 3 19.58 3 22 5.42 22 8.5c0 "
+	"3.78-3.4 6.86-8.55 11.54L12 21.35z",
+	// magnifier
+	"M15.5 14h-.79l-.28-.27A6.471 6.471 0 0 0 16 9.5 6.5 6.5 0 1 0 9.5 16c1.61 "
+	"0 3.09-.59 4.23-1.57l.27.28v.79l5 4.99L20.49 19l-4.99-5zm-6 0C7.01 14 "
+	"5 11.99 5 9.5S7.01 5 9.5 5 14 7.01 14 9.5 11.99 14 9.5 14z",
+	// star
+	"M12 17.27L18.18 21l-1.64-7.03L22 9.24l-7.19-.61L12 2 9.19 8.63 2 9.24l5.46 "
+	"4.73L5.82 21z",
+	// cloud
+	"M19.35 10.04A7.49 7.49 0 0 0 12 4C9.11 4 6.6 5.64 5.35 8.04A5.994 5.994 0 "
+	"0 0 0 14c0 3.31 2.69 6 6 6h13c2.76 0 5-2.24 5-5 0-2.64-2.05-4.78-4.65-4.96z",
+	// home
+	"M10 20v-6h4v6h5v-8h3L12 3 2 12h3v8z",
+	// settings gear
+	"M19.14 12.94c.04-.3.06-.61.06-.94 0-.32-.02-.64-.07-.94l2.03-1.58a.49.49 "
+	"0 0 0 .12-.61l-1.92-3.32a.488.488 0 0 0-.59-.22l-2.39.96c-.5-.38-1.03-.7"
+	"-1.62-.94l-.36-2.54a.484.484 0 0 0-.48-.41h-3.84c-.24 0-.43.17-.47.41l-.36 "
+	"2.54c-.59.24-1.13.57-1.62.94l-2.39-.96c-.22-.08-.47 0-.59.22L2.74 8.87c-.12"
+	".21-.08.47.12.61l2.03 1.58c-.05.3-.09.63-.09.94s.02.64.07.94l-2.03 "
+	"1.58a.49.49 0 0 0-.12.61l1.92 3.32c.12.22.37.29.59.22l2.39-.96c.5.38 1.03"
+	".7 1.62.94l.36 2.54c.05.24.24.41.48.41h3.84c.24 0 .44-.17.47-.41l.36-2.54c"
+	".59-.24 1.13-.56 1.62-.94l2.39.96c.22.08.47 0 .59-.22l1.92-3.32c.12-.22.07"
+	"-.47-.12-.61l-2.01-1.58zM12 15.6c-1.98 0-3.6-1.62-3.6-3.6s1.62-3.6 3.6-3.6 "
+	"3.6 1.62 3.6 3.6-1.62 3.6-3.6 3.6z",
+};
+
+// Random numbers that are the same on all platforms (in contrast to
+// the std distributions).
+class Random {
+public:
+	explicit Random(std::uint64_t seed) : state_(seed) {}
+
+	/// Returns a uniformly distributed value in [0, 1).
+	float uniform() {
+		// splitmix64
+		auto z = (state_ += 0x9E3779B97F4A7C15u);
+		z = (z ^ (z >> 30u)) * 0xBF58476D1CE4E5B9u;
+		z = (z ^ (z >> 27u)) * 0x94D049BB133111EBu;
+		z ^= (z >> 31u);
+		return float(z >> 40u) * (1.f / float(1u << 24u));
+	}
+
+	float range(float min, float max) {
+		return min + (max - min) * uniform();
+	}
+
+protected:
+	std::uint64_t state_;
+};
+
+struct Corpus {
+	std::string name;
+	std::vector<std::string> paths; // svg path data
+	std::string document; // svg document, for corpora from files
+};
+
+enum class CurveType {
+	cubic,
+	quad,
+	arc,
+	line,
+};
+
+void appendNumber(std::string& str, float value) {
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), " %.3f", value);
+	str += buf;
+}
+
+/// Generates subpaths random curves of the given type, with all
+/// coordinates in [0, scale].
+Corpus generate(std::string name, CurveType type, float scale,
+		unsigned subpaths, unsigned segments, std::uint64_t seed) {
+	Random random(seed);
+	auto coord = [&](std::string& str) {
+		appendNumber(str, random.range(0.f, scale));
+		appendNumber(str, random.range(0.f, scale));
+	};
+
+	Corpus corpus {std::move(name), {}, {}};
+	for(auto i = 0u; i < subpaths; ++i) {
+		std::string str = "M";
+		coord(str);
+		for(auto j = 0u; j < segments; ++j) {
+			switch(type) {
+				case CurveType::cubic:
+					str += " C";
+					coord(str);
+					coord(str);
+					coord(str);
+					break;
+				case CurveType::quad:
+					str += " Q";
+					coord(str);
+					coord(str);
+					break;
+				case CurveType::arc:
+					str += " A";
+					appendNumber(str, random.range(0.1f, 0.5f) * scale);
+					appendNumber(str, random.range(0.1f, 0.5f) * scale);
+					appendNumber(str, random.range(0.f, 360.f));
+					str += random.uniform() < 0.5f ? " 0" : " 1";
+					str += random.uniform() < 0.5f ? " 0" : " 1";
+					coord(str);
+					break;
+				case CurveType::line:
+					str += " L";
+					coord(str);
+					break;
+			}
+		}
+
+		str += " Z";
+		corpus.paths.push_back(std::move(str));
+	}
+
+	return corpus;
+}
+
+std::vector<Corpus> corpora() {
+	std::vector<Corpus> ret;
+	ret.push_back(generate("cubics-small", CurveType::cubic, 10.f, 64, 64, 1u));
+	ret.push_back(generate("cubics-large", CurveType::cubic, 1000.f, 64, 64, 2u));
+	ret.push_back(generate("quads-small", CurveType::quad, 10.f, 64, 64, 3u));
+	ret.push_back(generate("quads-large", CurveType::quad, 1000.f, 64, 64, 4u));
+	ret.push_back(generate("arcs-small", CurveType::arc, 10.f, 64, 16, 5u));
+	ret.push_back(generate("arcs-large", CurveType::arc, 1000.f, 64, 16, 6u));
+	ret.push_back(generate("polyline", CurveType::line, 1000.f, 4, 16384, 7u));
+
+	Corpus icons {"icons", {}, {}};
+	for(auto path : iconPaths) {
+		icons.paths.push_back(path);
+	}
+	ret.push_back(std::move(icons));
+
+	return ret;
+}
+
+struct Result {
+	std::string benchmark;
+	std::string corpus;
+	const char* unit; // what the items are
+	std::uint64_t calls;
+	double seconds;
+	std::uint64_t items; // per call
+	double allocs; // per call
+	double allocBytes; // per call
+	std::int64_t peakBytes; // heap peak during a call, above the baseline
+};
+
+struct Options {
+	double minTime = 0.5; // in seconds, per benchmark
+	std::string filter;
+};
+
+// Makes sure the results of benchmarked functions are not optimized out.
+std::atomic<std::uint64_t> sink {};
+
+/// Measures the given function that returns the number of processed
+/// items. After a warm-up call (that e.g. grows reused buffers), one
+/// call is used for allocation and memory statistics, then it is called
+/// until minTime is reached.
+template<typename F>
+void measure(std::vector<Result>& results, const Options& options,
+		const char* benchmark, const Corpus& corpus, const char* unit, F&& f) {
+	auto name = std::string(benchmark) + "/" + corpus.name;
+	if(name.find(options.filter) == std::string::npos) {
+		return;
+	}
+
+	Result result {benchmark, corpus.name, unit, 0u, 0.0, 0u, 0.0, 0.0, 0};
+
+	sink += f();
+
+	auto baseline = heapBytes.load();
+	heapPeak = baseline;
+	auto count = allocCount.load();
+	auto bytes = allocBytes.load();
+	result.items = f();
+	result.allocs = double(allocCount.load() - count);
+	result.allocBytes = double(allocBytes.load() - bytes);
+	result.peakBytes = heapPeak.load() - baseline;
+
+	auto start = Clock::now();
+	auto elapsed = 0.0;
+	while(elapsed < options.minTime || result.calls < 3u) {
+		sink += f();
+		++result.calls;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	result.seconds = elapsed;
+
+	auto perCall = elapsed / double(result.calls);
+	std::printf("%-32s %10.2f us/call %12.2f M%s/s %8.1f allocs/call\n",
+		name.c_str(), 1e6 * perCall, double(result.items) / perCall / 1e6,
+		unit, result.allocs);
+	results.push_back(std::move(result));
+}
+
+void run(std::vector<Result>& results, const Options& options,
+		const Corpus& corpus) {
+	std::vector<ktc::Path> paths;
+	if(!corpus.paths.empty()) {
+		std::uint64_t bytes = 0u;
+		for(auto& str : corpus.paths) {
+			bytes += str.size();
+			paths.push_back(ktc::parseSvgPath(str));
+		}
+
+		measure(results, options, "parseSvgPath", corpus, "bytes", [&]{
+			std::uint64_t count = 0u;
+			for(auto& str : corpus.paths) {
+				auto path = ktc::parseSvgPath(str);
+				count += path.subpaths.size();
+			}
+
+			sink += count;
+			return bytes;
+		});
+	}
+
+	if(!corpus.document.empty()) {
+		for(auto& elem : ktc::loadSvgDocument(corpus.document)) {
+			if(!elem.error) {
+				paths.push_back(std::move(elem.path));
+			}
+		}
+
+		measure(results, options, "loadSvgDocument", corpus, "bytes", [&]{
+			auto elements = ktc::loadSvgDocument(corpus.document);
+			sink += elements.size();
+			return std::uint64_t(corpus.document.size());
+		});
+	}
+
+	ktc::FlattenedPath flattened;
+	measure(results, options, "flatten", corpus, "points", [&]{
+		std::uint64_t count = 0u;
+		for(auto& path : paths) {
+			ktc::flatten(path, flattened);
+			count += flattened.points.size();
+		}
+
+		return count;
+	});
+
+	// the flattened polygons used by the stroke and fill benchmarks
+	std::vector<std::vector<ktc::Vec2f>> polygons;
+	for(auto& path : paths) {
+		for(auto& sub : path.subpaths) {
+			auto points = ktc::flatten(sub);
+			if(points.size() >= 3u) {
+				ktc::enforceWinding(points, false);
+				polygons.push_back(std::move(points));
+			}
+		}
+	}
+
+	std::uint64_t vertices = 0u;
+	auto countVertex = [&](const ktc::Vertex&) { ++vertices; };
+
+	measure(results, options, "bakeStroke", corpus, "vertices", [&]{
+		vertices = 0u;
+		auto settings = ktc::StrokeSettings {2.f, false};
+		for(auto& points : polygons) {
+			ktc::bakeStroke(points, settings, countVertex);
+		}
+
+		return vertices;
+	});
+
+	measure(results, options, "bakeDashedStroke", corpus, "vertices", [&]{
+		vertices = 0u;
+		auto settings = ktc::StrokeSettings {2.f, false};
+		const float array[] = {5.f, 3.f};
+		auto dash = ktc::DashPattern {array, 0.f};
+		for(auto& points : polygons) {
+			ktc::bakeDashedStroke(points, settings, dash, countVertex);
+		}
+
+		return vertices;
+	});
+
+	measure(results, options, "bakeFillAA", corpus, "vertices", [&]{
+		vertices = 0u;
+		for(auto& points : polygons) {
+			ktc::bakeFillAA(points, 1.f, countVertex, countVertex);
+		}
+
+		return vertices;
+	});
+
+	measure(results, options, "bakeCombinedFillAA", corpus, "vertices", [&]{
+		std::uint64_t count = 0u;
+		for(auto& points : polygons) {
+			auto fill = ktc::bakeCombinedFillAA(points, {}, 1.f);
+			count += fill.vertices.size();
+		}
+
+		return count;
+	});
+}
+
+/// Returns the peak resident set size of the process in bytes or 0
+/// if it is not known.
+std::uint64_t peakRss() {
+#ifdef KTC_BENCH_RUSAGE
+	rusage usage {};
+	getrusage(RUSAGE_SELF, &usage);
+	#ifdef __APPLE__
+		return std::uint64_t(usage.ru_maxrss);
+	#else
+		return std::uint64_t(usage.ru_maxrss) * 1024u;
+	#endif
+#else
+	return 0u;
+#endif
+}
+
+std::string escape(const std::string& str) {
+	std::string ret;
+	for(auto c : str) {
+		if(c == '"' || c == '\\') {
+			ret += '\\';
+		}
+
+		if(std::uint8_t(c) >= 0x20u) {
+			ret += c;
+		}
+	}
+
+	return ret;
+}
+
+void writeJson(std::FILE* file, const std::vector<Result>& results) {
+	std::fprintf(file, "{\n");
+	std::fprintf(file, "  \"version\": \"%s\",\n", KTC_VERSION);
+	std::fprintf(file, "  \"peakRssBytes\": %llu,\n",
+		(unsigned long long) peakRss());
+	std::fprintf(file, "  \"results\": [");
+	auto first = true;
+	for(auto& r : results) {
+		auto perCall = r.seconds / double(r.calls);
+		std::fprintf(file, "%s\n    {\"benchmark\": \"%s\", \"corpus\": \"%s\", "
+			"\"unit\": \"%s\", \"calls\": %llu, \"secondsPerCall\": %.9g, "
+			"\"itemsPerCall\": %llu, \"itemsPerSecond\": %.6g, "
+			"\"allocsPerCall\": %.6g, \"allocBytesPerCall\": %.6g, "
+			"\"peakHeapBytes\": %lld}",
+			first ? "" : ",", r.benchmark.c_str(), escape(r.corpus).c_str(), r.unit,
+			(unsigned long long) r.calls, perCall,
+			(unsigned long long) r.items, double(r.items) / perCall,
+			r.allocs, r.allocBytes, (long long) r.peakBytes);
+		first = false;
+	}
+
+	std::fprintf(file, "\n  ]\n}\n");
+}
+
+} // anon namespace
+
+int main(int argc, char** argv) {
+	Options options;
+	const char* json = nullptr;
+	std::vector<Corpus> all = corpora();
+
+	for(auto i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if(arg == "--json" && i + 1 < argc) {
+			json = argv[++i];
+		} else if(arg == "--filter" && i + 1 < argc) {
+			options.filter = argv[++i];
+		} else if(arg == "--quick") {
+			options.minTime = 0.05;
+		} else if(arg.size() > 1 && arg[0] == '-') {
+			std::fprintf(stderr, "Usage: %s [--json <file>] [--quick] "
+				"[--filter <str>] [<file.svg>...]\n", argv[0]);
+			return 1;
+		} else {
+			Corpus corpus {arg, {}, {}};
+			try {
+				ktc::MappedFile file(argv[i]);
+				corpus.document = file.view();
+			} catch(const std::exception& err) {
+				std::fprintf(stderr, "%s\n", err.what());
+				return 1;
+			}
+
+			all.push_back(std::move(corpus));
+		}
+	}
+
+	std::vector<Result> results;
+	for(auto& corpus : all) {
+		run(results, options, corpus);
+	}
+
+	if(json) {
+		auto file = std::strcmp(json, "-") ? std::fopen(json, "w") : stdout;
+		if(!file) {
+			std::fprintf(stderr, "Can't open %s\n", json);
+			return 1;
+		}
+
+		writeJson(file, results);
+		if(file != stdout) {
+			std::fclose(file);
+		}
+	}
+}
@@ -0,0 +1,192 @@
+#include <bugged.hpp>
+#include <katachi/curves.hpp>
+#include <nytl/vecOps.hpp>
+#include <nytl/approxVec.hpp>
+#include <nytl/span.hpp>
+#include <nytl/math.hpp>
+#include <dlg/dlg.hpp>
+#include <algorithm>
+
+using namespace nytl;
+
+// Forwarding utility to escape ',' in macros
+template<typename T>
+decltype(auto) id(T&& val) {
+	return std::forward<T>(val);
+}
+
+// Returns the distance from p to the nearest segment of the polyline
+float distance(Span<const Vec2f> polyline, Vec2f p) {
+	auto ret = length(p - polyline[0]);
+	for(auto i = 1u; i < polyline.size(); ++i) {
+		auto a = polyline[i - 1];
+		auto ab = polyline[i] - a;
+		auto l2 = dot(ab, ab);
+		auto t = l2 > 0.f ? std::clamp(dot(p - a, ab) / l2, 0.f, 1.f) : 0.f;
+		ret = std::min(ret, length(p - (a + t * ab)));
+	}
+
+	return ret;
+}
+
+Vec2f eval(const ktc::QuadBezier& b, float t) {
+	auto mt = 1 - t;
+	return (mt * mt) * b.start + (2 * mt * t) * b.control + (t * t) * b.end;
+}
+
+Vec2f eval(const ktc::CubicBezier& b, float t) {
+	auto mt = 1 - t;
+	return (mt * mt * mt) * b.start + (3 * mt * mt * t) * b.control1 +
+		(3 * mt * t * t) * b.control2 + (t * t * t) * b.end;
+}
+
+Vec2f eval(const ktc::CenterArc& arc, float t) {
+	auto a = arc.start + t * (arc.end - arc.start);
+	auto p = Vec {arc.radius.x * std::cos(a), arc.radius.y * std::sin(a)};
+	auto c = std::cos(arc.rotation), s = std::sin(arc.rotation);
+	return arc.center + Vec {c * p.x - s * p.y, s * p.x + c * p.y};
+}
+
+// Returns the maximum distance of the curve to the polyline
+template<typename B>
+float maxDistance(const B& b, Span<const Vec2f> polyline) {
+	auto ret = 0.f;
+	for(auto i = 0u; i <= 1000u; ++i) {
+		ret = std::max(ret, distance(polyline, eval(b, i / 1000.f)));
+	}
+
+	return ret;
+}
+
+TEST(quad) {
+	const ktc::QuadBezier curves[] = {
+		{{0.f, 0.f}, {100.f, 200.f}, {200.f, 0.f}},
+		{{10.f, 10.f}, {500.f, 10.f}, {10.f, 12.f}}, // cusp
+		{{0.f, 0.f}, {1.f, 1.f}, {2.f, 0.f}},
+		{{-300.f, 40.f}, {20.f, 1000.f}, {400.f, -20.f}},
+	};
+
+	for(auto tolerance : {1.f, 0.25f, 0.05f}) {
+		for(auto& curve : curves) {
+			std::vector<Vec2f> points = {curve.start};
+			ktc::flatten(curve, points, tolerance);
+
+			auto count = ktc::flattenedPointCount(curve, tolerance);
+			EXPECT(points.size(), count + 1);
+			EXPECT(points.back(), curve.end);
+			EXPECT(maxDistance(curve, points) <= 1.1f * tolerance, true);
+		}
+	}
+}
+
+TEST(quadLine) {
+	// straight lines must result in a single segment
+	auto line = ktc::QuadBezier{{0.f, 0.f}, {50.f, 50.f}, {100.f, 100.f}};
+	EXPECT(ktc::flattenedPointCount(line, 0.25f), 1u);
+
+	auto point = ktc::QuadBezier{{10.f, 10.f}, {10.f, 10.f}, {10.f, 10.f}};
+	std::vector<Vec2f> points;
+	ktc::flatten(point, points, 0.25f);
+	EXPECT(points.size(), 1u);
+	EXPECT(points[0], id(Vec {10.f, 10.f}));
+}
+
+TEST(cubic) {
+	const ktc::CubicBezier curves[] = {
+		{{0.f, 0.f}, {0.f, 100.f}, {100.f, 100.f}, {100.f, 0.f}},
+		{{0.f, 0.f}, {300.f, 100.f}, {-200.f, 100.f}, {100.f, 0.f}}, // loop
+		{{5.f, 5.f}, {6.f, 7.f}, {7.f, 4.f}, {8.f, 5.f}},
+		{{-500.f, 0.f}, {800.f, 900.f}, {-800.f, 900.f}, {500.f, 10.f}},
+	};
+
+	for(auto tolerance : {1.f, 0.25f, 0.05f}) {
+		for(auto& curve : curves) {
+			std::vector<Vec2f> points = {curve.start};
+			ktc::flatten(curve, points, tolerance);
+
+			auto count = ktc::flattenedPointCount(curve, tolerance);
+			EXPECT(points.size(), count + 1);
+			EXPECT(points.back(), curve.end);
+			EXPECT(maxDistance(curve, points) <= tolerance, true);
+		}
+	}
+
+	// straight line
+	auto line = ktc::CubicBezier{{0.f, 0.f}, {1.f, 1.f}, {2.f, 2.f}, {3.f, 3.f}};
+	EXPECT(ktc::flattenedPointCount(line, 0.25f), 1u);
+}
+
+TEST(batch) {
+	std::vector<ktc::CubicBezier> cubics;
+	std::vector<ktc::QuadBezier> quads;
+	// enough curves for multiple chunks in the quadratic batch
+	for(auto i = 0u; i < 150u; ++i) {
+		auto f = float(i % 11u);
+		auto o = Vec {10.f * float(i), -3.f * f};
+		cubics.push_back({o, o + Vec {f * f, 50.f}, o + Vec {100.f, -f}, o + Vec {200.f, 0.f}});
+		quads.push_back({o, o + Vec {5.f * f, 100.f - f * f}, o + Vec {80.f, 20.f}});
+	}
+
+	auto check = [](auto& curves) {
+		std::vector<Vec2f> points;
+		std::vector<unsigned> offsets;
+		ktc::flattenBatch(curves, points, offsets, 0.25f);
+
+		EXPECT(offsets.size(), curves.size() + 1);
+		EXPECT(offsets.back(), points.size());
+		for(auto i = 0u; i < curves.size(); ++i) {
+			auto& curve = curves[i];
+			auto count = offsets[i + 1] - offsets[i];
+			EXPECT(count, ktc::flattenedPointCount(curve, 0.25f));
+			EXPECT(points[offsets[i + 1] - 1], curve.end);
+
+			std::vector<Vec2f> polyline = {curve.start};
+			polyline.insert(polyline.end(), points.begin() + offsets[i],
+				points.begin() + offsets[i + 1]);
+			EXPECT(maxDistance(curve, polyline) <= 0.3f, true);
+		}
+	};
+
+	check(cubics);
+	check(quads);
+}
+
+TEST(arc) {
+	const ktc::EndArc arcs[] = {
+		{{300.f, 200.f}, {150.f, 200.f}, {150.f, 150.f}, false, false},
+		{{300.f, 200.f}, {300.f, 50.f}, {150.f, 150.f}, true, false},
+		{{0.f, 0.f}, {50.f, -25.f}, {25.f, 100.f}, false, true, -0.5f},
+		{{10.f, 10.f}, {30.f, 30.f}, {40.f, 10.f}, true, true, 2.f},
+		// radius too small, will be scaled up to form a half ellipse
+		{{10.f, 10.f}, {300.f, 30.f}, {1.f, 2.f}, false, true, 1.f},
+	};
+
+	for(auto& earc : arcs) {
+		auto arc = ktc::endToCenter(earc);
+		auto delta = std::abs(arc.end - arc.start);
+		EXPECT(eval(arc, 0.f), approx(earc.from));
+		EXPECT(eval(arc, 1.f), approx(earc.to));
+		EXPECT(arc.end > arc.start, earc.clockwise);
+
+		auto back = ktc::centerToEnd(arc);
+		EXPECT(back.from, approx(earc.from));
+		EXPECT(back.to, approx(earc.to));
+		EXPECT(back.clockwise, earc.clockwise);
+
+		if(&earc == &arcs[4]) {
+			EXPECT(std::abs(delta - nytl::constants::pi) < 1e-4, true);
+		} else {
+			EXPECT(delta > nytl::constants::pi, earc.largeArc);
+			EXPECT(back.largeArc, earc.largeArc);
+		}
+
+		for(auto tolerance : {1.f, 0.25f}) {
+			auto steps = ktc::flattenedPointCount(arc, tolerance);
+			std::vector<Vec2f> points = {earc.from};
+			ktc::flatten(arc, points, steps);
+			EXPECT(points.size(), steps + 1);
+			EXPECT(points.back(), approx(earc.to));
+			EXPECT(maxDistance(arc, points) <= 1.01f * tolerance, true);
+		}
+	}
+}
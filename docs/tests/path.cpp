@@ -0,0 +1,455 @@
+#include <bugged.hpp>
+#include <katachi/path.hpp>
+#include <katachi/svg.hpp>
+#include <katachi/cache.hpp>
+#include <katachi/compactPath.hpp>
+#include <katachi/arena.hpp>
+#include <katachi/binaryPath.hpp>
+#include <katachi/stats.hpp>
+#include <katachi/stroke.hpp>
+#include <nytl/approxVec.hpp>
+#include <nytl/span.hpp>
+#include <nytl/vecOps.hpp>
+#include <dlg/dlg.hpp>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+using namespace nytl;
+
+// Forwarding utility to escape ',' in macros
+template<typename T>
+decltype(auto) id(T&& val) {
+	return std::forward<T>(val);
+}
+
+const auto pathString =
+	"M 10 10 L 100 10 Q 150 10 150 60 T 150 200 "
+	"C 150 300 0 300 0 200 S -40 100 10 100 "
+	"A 40 20 30 1 1 60 100 a 0 10 0 0 0 10 10 Z";
+
+TEST(count) {
+	auto subpath = ktc::parseSvgSubpath(pathString);
+	for(auto tolerance : {1.f, 0.25f, 0.01f}) {
+		auto settings = ktc::FlattenSettings {};
+		settings.qBezTolerance = tolerance;
+		settings.cBezTolerance = tolerance;
+		settings.arcTolerance = tolerance;
+
+		auto points = ktc::flatten(subpath, settings);
+		EXPECT(ktc::flattenedPointCount(subpath, settings), points.size());
+		EXPECT(points.front(), id(Vec {10.f, 10.f}));
+		EXPECT(points.back(), id(Vec {10.f, 10.f}));
+		EXPECT(points[points.size() - 2], id(Vec {70.f, 110.f}));
+	}
+
+	EXPECT(ktc::flattenedPointCount(ktc::Subpath {}), 0u);
+}
+
+TEST(outputs) {
+	auto subpath = ktc::parseSvgSubpath(pathString);
+	auto points = ktc::flatten(subpath);
+
+	// span
+	std::vector<Vec2f> buf(points.size() + 5);
+	auto count = ktc::flatten(subpath, Span<Vec2f>(buf));
+	EXPECT(count, points.size());
+	for(auto i = 0u; i < count; ++i) {
+		EXPECT(buf[i], points[i]);
+	}
+
+	// append into reused vector
+	std::vector<Vec2f> reused = {{1.f, 2.f}};
+	ktc::flatten(subpath, reused);
+	EXPECT(reused.size(), points.size() + 1);
+	EXPECT(reused[1], points[0]);
+	EXPECT(reused.back(), points.back());
+
+	auto capacity = reused.capacity();
+	auto data = reused.data();
+	reused.clear();
+	ktc::flatten(subpath, reused);
+	EXPECT(reused.size(), points.size());
+	EXPECT(reused.capacity(), capacity);
+	EXPECT(reused.data(), data);
+}
+
+TEST(transform) {
+	auto subpath = ktc::parseSvgSubpath(pathString);
+
+	// uniform scale: same as flattening in local space with
+	// a tolerance divided by the scale
+	auto transform = ktc::Transform {{4.f, 0.f}, {0.f, 4.f}, {-20.f, 100.f}};
+	EXPECT(ktc::maxScale(transform), 4.f);
+
+	auto local = ktc::FlattenSettings {};
+	local.arcTolerance /= 4.f;
+	local.qBezTolerance /= 4.f;
+	local.cBezTolerance /= 4.f;
+
+	auto points = ktc::flatten(subpath, {}, transform);
+	auto localPoints = ktc::flatten(subpath, local);
+	EXPECT(points.size(), localPoints.size());
+	EXPECT(ktc::flattenedPointCount(subpath, {}, transform), points.size());
+	for(auto i = 0u; i < points.size(); ++i) {
+		auto p = ktc::apply(transform, localPoints[i]);
+		EXPECT(length(points[i] - p) < 0.01f, true);
+	}
+
+	// zooming out reduces the number of points
+	auto small = ktc::Transform {{0.1f, 0.f}, {0.f, 0.1f}, {}};
+	auto smallCount = ktc::flattenedPointCount(subpath, {}, small);
+	EXPECT(smallCount < ktc::flattenedPointCount(subpath), true);
+	EXPECT(smallCount < points.size(), true);
+
+	// rotation, shear
+	auto rot = ktc::Transform {{0.f, 1.f}, {-1.f, 0.f}, {5.f, 5.f}};
+	auto shear = ktc::Transform {{1.f, 0.f}, {0.5f, 1.f}, {}};
+	for(auto& t : {rot, shear, rot * shear}) {
+		auto tpoints = ktc::flatten(subpath, {}, t);
+		EXPECT(tpoints.front(), approx(ktc::apply(t, subpath.start)));
+		EXPECT(tpoints.back(), approx(ktc::apply(t, subpath.start)));
+		EXPECT(tpoints[tpoints.size() - 2], approx(ktc::apply(t, {70.f, 110.f})));
+	}
+
+	EXPECT(std::abs(ktc::maxScale(rot) - 1.f) < 1e-6f, true);
+	auto composed = rot * shear;
+	EXPECT(ktc::apply(composed, {1.f, 2.f}),
+		approx(ktc::apply(rot, ktc::apply(shear, {1.f, 2.f}))));
+}
+
+TEST(cache) {
+	auto subpath = ktc::parseSvgSubpath(pathString);
+	auto other = ktc::parseSvgSubpath("M 0 0 Q 50 100 100 0 Z");
+
+	ktc::FlattenCache cache;
+	auto points = cache.flatten(subpath);
+	auto expected = ktc::flatten(subpath);
+	EXPECT(points.size(), expected.size());
+	EXPECT(points.back(), expected.back());
+	EXPECT(cache.stats().misses, 1u);
+	EXPECT(cache.stats().hits, 0u);
+	EXPECT(cache.stats().entries, 1u);
+
+	// hit, also for an equal copy
+	auto copy = subpath;
+	EXPECT(cache.flatten(copy).data(), points.data());
+	EXPECT(cache.stats().hits, 1u);
+
+	// changed content
+	copy.commands[0].to.x += 1.f;
+	EXPECT(ktc::contentHash(copy) != ktc::contentHash(subpath), true);
+	cache.flatten(copy);
+	EXPECT(cache.stats().misses, 2u);
+
+	// scales in the same bucket share an entry, larger ones
+	// have more points
+	auto big = cache.flatten(subpath, {}, 4.f);
+	EXPECT(cache.stats().misses, 3u);
+	EXPECT(cache.flatten(subpath, {}, 3.9f).data(), big.data());
+	EXPECT(cache.stats().hits, 2u);
+	EXPECT(big.size() > points.size(), true);
+
+	// eviction of the least recently used entries
+	auto bytes = cache.stats().bytes;
+	EXPECT(bytes > 0u, true);
+	cache.flatten(other);
+	cache.maxBytes(bytes / 2);
+	EXPECT(cache.stats().bytes <= bytes / 2, true);
+	EXPECT(cache.stats().evictions > 0u, true);
+	auto misses = cache.stats().misses;
+	cache.flatten(other);
+	EXPECT(cache.stats().misses, misses);
+
+	cache.clear();
+	EXPECT(cache.stats().entries, 0u);
+	EXPECT(cache.stats().bytes, 0u);
+
+	// colliding hashes don't return the points of another subpath
+	auto hash = ktc::contentHash(subpath);
+	cache.flatten(subpath, hash);
+	auto collided = cache.flatten(other, hash);
+	EXPECT(collided.size(), ktc::flatten(other).size());
+	EXPECT(collided.back(), other.start);
+	EXPECT(cache.stats().entries, 1u);
+}
+
+TEST(wholePath) {
+	auto path = ktc::parseSvgPath(
+		"M 0 0 L 100 0 L 100 100 Z "
+		"M 200 200 Q 250 300 300 200 C 300 100 400 100 400 200 "
+		"M 0 500 A 100 50 0 1 1 200 500");
+	EXPECT(path.subpaths.size(), 3u);
+
+	auto serial = ktc::flatten(path);
+	EXPECT(serial.size(), 3u);
+	EXPECT(serial.offsets.front(), 0u);
+	EXPECT(serial.offsets.back(), serial.points.size());
+	for(auto i = 0u; i < serial.size(); ++i) {
+		auto expected = ktc::flatten(path.subpaths[i]);
+		auto points = serial.subpath(i);
+		EXPECT(points.size(), expected.size());
+		EXPECT(points.front(), expected.front());
+		EXPECT(points.back(), expected.back());
+	}
+
+	// parallel output is identical and reuses the given buffers
+	ktc::ThreadPool pool(4);
+	EXPECT(pool.threadCount(), 4u);
+	ktc::FlattenedPath parallel;
+	ktc::flatten(path, parallel, {}, {}, pool.executor());
+	EXPECT(parallel.offsets == serial.offsets, true);
+	EXPECT(parallel.points.size(), serial.points.size());
+	auto same = true;
+	for(auto i = 0u; i < serial.points.size(); ++i) {
+		same &= (parallel.points[i] == serial.points[i]);
+	}
+	EXPECT(same, true);
+
+	ktc::flatten(ktc::Path {}, parallel, {}, {}, pool.executor());
+	EXPECT(parallel.size(), 0u);
+	EXPECT(parallel.points.empty(), true);
+
+	// nested calls on the same pool don't deadlock
+	std::atomic<unsigned> nested {};
+	pool.parallelFor(8u, [&](unsigned) {
+		pool.parallelFor(4u, [&](unsigned) { ++nested; });
+	});
+	EXPECT(nested.load(), 32u);
+}
+
+TEST(compact) {
+	auto path = ktc::parseSvgPath(
+		"M 0 0 L 100 0 L 100 100 Z "
+		"M 200 200 Q 250 300 300 200 T 400 200 S 500 300 600 200 "
+		"M 0 500 A 100 50 30 1 0 200 500 a 20 20 0 0 1 20 20 "
+		"C 300 400 350 400 400 500");
+
+	auto compact = ktc::compact(path);
+	EXPECT(compact.size(), 3u);
+	EXPECT(compact.verbs.size(), 8u);
+	EXPECT(compact.arcRotations.size(), 2u);
+	EXPECT(compact.verbs[5], ktc::Verb::arcLarge);
+	EXPECT(compact.verbs[6], ktc::Verb::arcClockwise);
+
+	auto sub = compact.subpath(1);
+	EXPECT(sub.closed, false);
+	EXPECT(sub.verbs.size(), 3u);
+	EXPECT(sub.points.size(), 6u);
+	EXPECT(sub.points[0], (nytl::Vec2f {200.f, 200.f}));
+	EXPECT(compact.subpath(0).closed, true);
+
+	// round trip
+	auto expanded = ktc::expand(compact);
+	EXPECT(expanded.subpaths.size(), path.subpaths.size());
+	auto& arc = std::get<ktc::ArcParams>(expanded.subpaths[2].commands[0].params);
+	EXPECT(arc.radius, (nytl::Vec2f {100.f, 50.f}));
+	EXPECT(arc.largeArc, true);
+	EXPECT(arc.clockwise, false);
+
+	// flattening gives the same results as for the path
+	auto expected = ktc::flatten(path);
+	ktc::FlattenedPath flattened;
+	ktc::flatten(compact, flattened);
+	EXPECT(flattened.offsets == expected.offsets, true);
+	EXPECT(flattened.points.size(), expected.points.size());
+	auto same = true;
+	for(auto i = 0u; i < expected.points.size(); ++i) {
+		same &= (flattened.points[i] == expected.points[i]);
+	}
+	EXPECT(same, true);
+
+	// build directly
+	ktc::CompactPath built;
+	built.move({0.f, 0.f});
+	built.line({100.f, 0.f});
+	built.line({100.f, 100.f});
+	built.close();
+	EXPECT(ktc::flattenedPointCount(built.subpath(0)), 4u);
+	std::vector<nytl::Vec2f> points;
+	ktc::flatten(built.subpath(0), points);
+	EXPECT(points.size(), 4u);
+	EXPECT(points.back(), (nytl::Vec2f {0.f, 0.f}));
+}
+
+TEST(arena) {
+	ktc::FrameArena arena(1024);
+	EXPECT(arena.capacity(), 0u);
+
+	// objects using the arena must be destroyed before it is released
+	{
+		ktc::Path path(&arena);
+		auto& sub = path.move({0.f, 0.f});
+		sub.line({100.f, 0.f});
+		sub.qBezier({100.f, 100.f}, {{150.f, 50.f}});
+		sub.closed = true;
+		EXPECT(sub.commands.get_allocator().resource() == &arena, true);
+		EXPECT(arena.used() > 0u, true);
+
+		ktc::FlattenedPath flat(&arena);
+		ktc::flatten(path, flat);
+		EXPECT(flat.points.get_allocator().resource() == &arena, true);
+		EXPECT(flat.subpath(0).size(), ktc::flattenedPointCount(sub));
+
+		std::pmr::vector<nytl::Vec2f> points(&arena);
+		ktc::flatten(sub, points);
+		EXPECT(points.size(), flat.points.size());
+		EXPECT(points.back(), flat.points.back());
+
+		// copies use the default resource unless given one
+		auto copy = path;
+		EXPECT(copy.subpaths[0].commands.get_allocator().resource() ==
+			std::pmr::get_default_resource(), true);
+	}
+
+	// large allocations get their own block, reset reuses all blocks
+	auto big = arena.allocate(4096);
+	EXPECT(big != nullptr, true);
+	auto capacity = arena.capacity();
+	EXPECT(capacity >= 4096u + 1024u, true);
+
+	arena.reset();
+	EXPECT(arena.used(), 0u);
+	for(auto i = 0u; i < 16; ++i) {
+		(void) arena.allocate(64, 16);
+	}
+	(void) arena.allocate(4000);
+	EXPECT(arena.capacity(), capacity);
+
+	auto aligned = arena.allocate(8, 64);
+	EXPECT(reinterpret_cast<std::uintptr_t>(aligned) % 64, 0u);
+
+	arena.release();
+	EXPECT(arena.capacity(), 0u);
+}
+
+TEST(binary) {
+	auto path = ktc::parseSvgPath(
+		"M 0 0 L 100 0 L 100 100 Z "
+		"M 200 200 Q 250 300 300 200 T 400 200 S 500 300 600 200 "
+		"M 0 500 A 100 50 30 1 0 200 500");
+	auto square = ktc::parseSvgPath("M 0 0 h 10 v 10 h -10 Z");
+
+	ktc::BinaryPathWriter writer;
+	EXPECT(writer.add(path, "path"), 0u);
+	EXPECT(writer.add(ktc::Path {}), 1u);
+	EXPECT(writer.add(ktc::compact(square), "square"), 2u);
+	auto data = writer.serialize();
+
+	auto check = [&](const ktc::BinaryPathFile& file) {
+		EXPECT(file.size(), 3u);
+		EXPECT(file.name(0) == "path", true);
+		EXPECT(file.name(1).empty(), true);
+		EXPECT(file.find("square").value_or(0u), 2u);
+		EXPECT(file.find("circle").has_value(), false);
+		EXPECT(file.subpathCount(0), 3u);
+		EXPECT(file.subpathCount(1), 0u);
+		EXPECT(file.subpath(2, 0).closed, true);
+
+		auto expected = ktc::flatten(path);
+		ktc::FlattenedPath flattened;
+		ktc::flatten(file, 0u, flattened);
+		EXPECT(flattened.offsets == expected.offsets, true);
+		EXPECT(flattened.points.size(), expected.points.size());
+		auto same = true;
+		for(auto i = 0u; i < expected.points.size(); ++i) {
+			same &= (flattened.points[i] == expected.points[i]);
+		}
+		EXPECT(same, true);
+
+		auto copy = file.path(2);
+		EXPECT(copy.subpaths.size(), 1u);
+		EXPECT(copy.subpaths[0].commands.size(), 3u);
+		EXPECT(copy.subpaths[0].commands[1].to, (nytl::Vec2f {10.f, 10.f}));
+	};
+
+	check(ktc::BinaryPathFile(ktc::Span<const std::byte>(data)));
+
+	auto filename = "katachi_test_paths.bin";
+	writer.write(filename);
+	check(ktc::BinaryPathFile(filename));
+	std::remove(filename);
+
+	// corrupt data is detected on load
+	auto throws = [](std::vector<std::byte> data) {
+		try {
+			ktc::BinaryPathFile file {ktc::Span<const std::byte>(data)};
+		} catch(const std::runtime_error&) {
+			return true;
+		}
+		return false;
+	};
+
+	EXPECT(throws(data), false);
+	EXPECT(throws({}), true);
+	EXPECT(throws({data.begin(), data.end() - 1}), true);
+
+	auto wrongMagic = data;
+	wrongMagic[0] = std::byte {0};
+	EXPECT(throws(wrongMagic), true);
+
+	auto wrongVerb = data;
+	wrongVerb[data.size() - 10 - 2] = std::byte {0xFF};
+	EXPECT(throws(wrongVerb), true);
+
+	// subpath range beyond the data. Without names, the verbs are at the
+	// end of the data. The second range follows the path index
+	// (1 path + 1 entries) and the first range
+	ktc::BinaryPathWriter unnamed;
+	unnamed.add(path);
+	auto wrongRange = unnamed.serialize();
+	EXPECT(throws(wrongRange), false);
+	auto rangeOffset = sizeof(ktc::BinaryPathHeader) + 4 * (1 + 1) +
+		sizeof(ktc::BinarySubpathRange);
+	std::uint32_t verb = 1u << 28;
+	std::memcpy(wrongRange.data() + rangeOffset, &verb, sizeof(verb));
+	EXPECT(throws(wrongRange), true);
+}
+
+TEST(stats) {
+	auto path = ktc::parseSvgPath(
+		"M 0 0 L 100 0 Q 200 0 200 100 C 200 200 100 200 100 100 "
+		"A 50 50 0 0 0 0 0 Z");
+
+	ktc::resetThreadStats();
+	auto flattened = ktc::flatten(path);
+	auto& stats = ktc::threadStats();
+	if(!ktc::statsEnabled()) {
+		EXPECT(stats.linePoints, 0u);
+		EXPECT(stats.cubicPoints, 0u);
+		return;
+	}
+
+	// counting the points before writing them is not recorded
+	EXPECT(stats.linePoints + stats.quadPoints + stats.cubicPoints +
+		stats.arcPoints, flattened.points.size());
+	EXPECT(stats.linePoints, 3u); // start, line, closing point
+
+	auto curves = [](const ktc::Stats::Histogram& histogram) {
+		auto sum = std::uint64_t(0u);
+		for(auto count : histogram) {
+			sum += count;
+		}
+		return sum;
+	};
+
+	EXPECT(curves(stats.quadSegments), 1u);
+	EXPECT(curves(stats.cubicSegments), 1u);
+	EXPECT(curves(stats.arcSteps), 1u);
+
+	// doubled points are skipped
+	std::vector<nytl::Vec2f> points = {{0.f, 0.f}, {10.f, 0.f}, {10.f, 0.f},
+		{10.f, 10.f}};
+	ktc::bakeStroke(points, {2.f, true}, [](const ktc::Vertex&) {});
+	EXPECT(stats.degeneratePoints >= 1u, true);
+	EXPECT(stats.strokeVertices > 0u, true);
+
+	auto sum = ktc::Stats {};
+	sum += stats;
+	sum += stats;
+	EXPECT(sum.linePoints, 2 * stats.linePoints);
+
+	ktc::resetThreadStats();
+	EXPECT(stats.linePoints, 0u);
+}
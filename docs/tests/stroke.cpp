@@ -0,0 +1,429 @@
+#include <bugged.hpp>
+#include <katachi/stroke.hpp>
+#include <katachi/vertexFormat.hpp>
+#include <nytl/vecOps.hpp>
+#include <nytl/approxVec.hpp>
+#include <nytl/span.hpp>
+#include <dlg/dlg.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+using namespace nytl;
+
+// Forwarding utility to escape ',' in macros
+template<typename T>
+decltype(auto) id(T&& val) {
+	return std::forward<T>(val);
+}
+
+namespace ktc {
+bool operator==(const Vertex& a, const Vertex& b) {
+	return a.position == b.position && a.aa == b.aa && a.color == b.color;
+}
+} // namespace ktc
+
+const std::vector<Vec2f> polyline = {{0.f, 0.f}, {10.f, 0.f}, {10.f, 0.f},
+	{20.f, 5.f}, {20.f, 20.f}, {0.f, 20.f}};
+
+// Returns the distance from p to the nearest segment of the polyline
+float distance(Span<const Vec2f> polyline, Vec2f p) {
+	auto ret = length(p - polyline[0]);
+	for(auto i = 1u; i < polyline.size(); ++i) {
+		auto a = polyline[i - 1];
+		auto ab = polyline[i] - a;
+		auto l2 = dot(ab, ab);
+		auto t = l2 > 0.f ? std::clamp(dot(p - a, ab) / l2, 0.f, 1.f) : 0.f;
+		ret = std::min(ret, length(p - (a + t * ab)));
+	}
+
+	return ret;
+}
+
+std::vector<ktc::Vertex> stroke(Span<const Vec2f> points,
+		const ktc::StrokeSettings& settings) {
+	std::vector<ktc::Vertex> ret;
+	ktc::bakeStroke(points, settings, [&](const ktc::Vertex& v) {
+		ret.push_back(v);
+	});
+	return ret;
+}
+
+TEST(handlers) {
+	// the templated versions must produce the same output as the
+	// std::function versions
+	for(auto loop : {false, true}) {
+		auto settings = ktc::StrokeSettings {2.f, loop};
+
+		std::vector<ktc::Vertex> direct;
+		ktc::bakeStroke(polyline, settings, [&](const ktc::Vertex& v) {
+			direct.push_back(v);
+		});
+
+		// non-const lvalues and rvalues of VertexHandlerFn would bind
+		// to the templates, as_const selects the std::function version
+		std::vector<ktc::Vertex> fn;
+		ktc::VertexHandlerFn handler = [&](const ktc::Vertex& v) {
+			fn.push_back(v);
+		};
+		ktc::bakeStroke(polyline, settings, std::as_const(handler));
+
+		EXPECT(direct.size(), fn.size());
+		EXPECT(direct == fn, true);
+		EXPECT(direct.size(), loop ? 12u : 14u); // one doubled point
+	}
+
+	std::vector<ktc::Vertex> fill, stroke;
+	auto fillFn = [&](const ktc::Vertex& v) { fill.push_back(v); };
+	auto strokeFn = [&](const ktc::Vertex& v) { stroke.push_back(v); };
+	ktc::bakeFillAA(polyline, 1.f, fillFn, strokeFn);
+
+	std::vector<ktc::Vertex> fill2, stroke2;
+	const ktc::VertexHandlerFn fillFn2 = [&](const ktc::Vertex& v) {
+		fill2.push_back(v);
+	};
+	const ktc::VertexHandlerFn strokeFn2 = [&](const ktc::Vertex& v) {
+		stroke2.push_back(v);
+	};
+	ktc::bakeFillAA(polyline, 1.f, fillFn2, strokeFn2);
+
+	EXPECT(fill.size(), 5u);
+	EXPECT(stroke.size(), 10u);
+	EXPECT(fill == fill2, true);
+	EXPECT(stroke == stroke2, true);
+}
+
+TEST(half) {
+	EXPECT(ktc::toHalf(0.f), 0x0000u);
+	EXPECT(ktc::toHalf(-0.f), 0x8000u);
+	EXPECT(ktc::toHalf(1.f), 0x3C00u);
+	EXPECT(ktc::toHalf(-2.f), 0xC000u);
+	EXPECT(ktc::toHalf(65504.f), 0x7BFFu); // largest half
+	EXPECT(ktc::toHalf(1e6f), 0x7C00u); // infinity
+	EXPECT(ktc::toHalf(5.9604645e-8f), 0x0001u); // smallest subnormal
+	EXPECT(ktc::toHalf(1.f + 1.f / 2048.f), 0x3C00u); // ties to even
+	EXPECT(ktc::toHalf(1.f + 3.f / 2048.f), 0x3C02u);
+
+	for(auto v : {0.f, 1.f, -2.5f, 1000.f, 0.333f, 5.9604645e-8f, 65504.f}) {
+		auto h = ktc::toHalf(v);
+		EXPECT(ktc::toHalf(ktc::fromHalf(h)), h);
+		EXPECT(std::abs(ktc::fromHalf(h) - v) <= std::abs(v) / 1024.f, true);
+	}
+}
+
+TEST(formats) {
+	std::vector<ktc::Vertex> vertices;
+	auto settings = ktc::StrokeSettings {2.f, false};
+	ktc::bakeStroke(polyline, settings, [&](const ktc::Vertex& v) {
+		vertices.push_back(v);
+	});
+
+	auto n = vertices.size();
+
+	// structure of arrays, without colors
+	std::vector<Vec2f> positions(n), aa(n);
+	auto soa = ktc::SoAWriter<> {positions, aa, {}};
+	ktc::bakeStroke(polyline, settings, soa);
+	EXPECT(soa.count, n);
+	for(auto i = 0u; i < n; ++i) {
+		EXPECT(positions[i], vertices[i].position);
+		EXPECT(aa[i], vertices[i].aa);
+	}
+
+	// packed half float positions, snorm8 aa, no color
+	using Half = ktc::PackedVertex<ktc::F16Position, ktc::Snorm8AA, false>;
+	static_assert(sizeof(Half) == 6u);
+
+	std::vector<Half> halfs(15u);
+	auto packed = ktc::PackedWriter<ktc::F16Position, ktc::Snorm8AA, false> {halfs};
+	ktc::bakeFillAA(polyline, 1.f, packed, packed);
+	EXPECT(packed.count, 15u);
+	for(auto& h : halfs) {
+		EXPECT(h.aa.x, 127);
+		EXPECT(h.aa.y == 0 || h.aa.y == 127, true);
+	}
+
+	// packed fixed point positions with color
+	using Fixed = ktc::PackedVertex<ktc::FixedPosition, ktc::Snorm8AA>;
+	std::vector<Fixed> fixed(n);
+	auto fixedWriter = ktc::PackedWriter<ktc::FixedPosition, ktc::Snorm8AA> {fixed};
+	fixedWriter.position = {{10.f, 10.f}, 8.f};
+	ktc::bakeStroke(polyline, settings, fixedWriter);
+	EXPECT(fixedWriter.count, n);
+	for(auto i = 0u; i < n; ++i) {
+		auto p = vertices[i].position;
+		auto& f = fixed[i];
+		EXPECT(std::abs(f.position.x / 8.f + 10.f - p.x) <= 1 / 16.f, true);
+		EXPECT(std::abs(f.position.y / 8.f + 10.f - p.y) <= 1 / 16.f, true);
+		EXPECT(f.aa.x, std::int8_t(127 * vertices[i].aa.x));
+		EXPECT(f.aa.y, std::int8_t(127 * vertices[i].aa.y));
+		EXPECT(f.color, vertices[i].color);
+	}
+}
+
+TEST(counts) {
+	using ktc::LineJoin;
+	for(auto loop : {false, true})
+	for(auto capFringe : {0.f, 1.f})
+	for(auto join : {LineJoin::miter, LineJoin::bevel, LineJoin::round}) {
+		{
+			auto settings = ktc::StrokeSettings {10.f, loop, capFringe};
+			settings.join = join;
+			auto count = ktc::strokeVertexCount(polyline, settings);
+
+			std::vector<ktc::Vertex> vertices(count);
+			EXPECT(ktc::bakeStroke(polyline, settings, vertices), count);
+
+			std::vector<ktc::Vertex> handled;
+			ktc::bakeStroke(polyline, settings, [&](const ktc::Vertex& v) {
+				handled.push_back(v);
+			});
+			EXPECT(handled == vertices, true);
+		}
+	}
+
+	auto fillCount = ktc::fillAAVertexCount(polyline);
+	EXPECT(fillCount.fill, 5u);
+	EXPECT(fillCount.stroke, 10u);
+
+	std::vector<ktc::Vertex> fill(fillCount.fill), stroke(fillCount.stroke);
+	auto written = ktc::bakeFillAA(polyline, 1.f, fill, stroke);
+	EXPECT(written.fill, fillCount.fill);
+	EXPECT(written.stroke, fillCount.stroke);
+
+	// combined fill, with a skipped (doubled) point
+	auto count = ktc::combinedFillAACount(polyline);
+	auto combined = ktc::bakeCombinedFillAA(polyline, {}, 1.f);
+	EXPECT(count.vertices, combined.vertices.size());
+	EXPECT(count.indices, combined.indices.size());
+	EXPECT(count.vertices, 12u); // 5 points + loop, fill and stroke
+	for(auto index : combined.indices) {
+		EXPECT(index < count.vertices, true);
+	}
+
+	auto base = 7u;
+	std::vector<ktc::Vertex> vertices(count.vertices);
+	std::vector<unsigned> indices(count.indices);
+	auto combinedWritten = ktc::bakeCombinedFillAA(polyline, {}, 1.f,
+		vertices, indices, base);
+	EXPECT(combinedWritten.vertices, count.vertices);
+	EXPECT(combinedWritten.indices, count.indices);
+	EXPECT(vertices == id(std::vector<ktc::Vertex>(combined.vertices.begin(),
+		combined.vertices.end())), true);
+	for(auto i = 0u; i < indices.size(); ++i) {
+		EXPECT(indices[i], combined.indices[i] + base);
+	}
+
+	EXPECT(ktc::strokeVertexCount({}, {2.f, false}), 0u);
+	EXPECT(ktc::combinedFillAACount({}).indices, 0u);
+}
+
+TEST(joins) {
+	using ktc::LineJoin;
+
+	// very sharp turn, a miter join would be 200 times the width
+	std::vector<Vec2f> spike = {{0.f, 0.f}, {100.f, 0.f}, {0.f, 1.f}};
+	auto settings = ktc::StrokeSettings {4.f, false};
+	auto half = 0.5f * (settings.width + settings.fringe);
+
+	for(auto join : {LineJoin::miter, LineJoin::bevel, LineJoin::round}) {
+		settings.join = join;
+		for(auto& v : stroke(spike, settings)) {
+			auto d = distance(spike, v.position);
+			EXPECT(std::isfinite(d), true);
+			EXPECT(d <= half + settings.capFringe + 0.01f, true);
+		}
+	}
+
+	// miter joins within the limit
+	std::vector<Vec2f> corner = {{0.f, 0.f}, {100.f, 0.f}, {100.f, 100.f}};
+	settings.join = LineJoin::miter;
+	auto miter = stroke(corner, settings);
+	EXPECT(miter.size(), 10u); // 2 caps, 1 join
+	auto far = 0.f;
+	for(auto& v : miter) {
+		far = std::max(far, distance(corner, v.position));
+	}
+	EXPECT(std::abs(far - std::sqrt(2.f) * half) < 0.01f, true);
+
+	settings.miterLimit = 1.2f; // < sqrt(2)
+	EXPECT(stroke(corner, settings).size(), 12u);
+	settings.join = LineJoin::bevel;
+	EXPECT(stroke(corner, settings).size(), 12u);
+
+	// round joins: the arc points are on the circle, the number of
+	// points depends on the width
+	settings.join = LineJoin::round;
+	auto thin = stroke(corner, settings);
+	for(auto& v : thin) {
+		auto cap = 0.5f * settings.capFringe;
+		EXPECT(distance(corner, v.position) <= half + cap + 0.01f, true);
+		if(v.position.x > 100.f && v.position.y < 0.f) {
+			EXPECT(std::abs(length(v.position - corner[1]) - half) < 0.01f, true);
+		}
+	}
+
+	settings.width = 100.f;
+	auto thick = stroke(corner, settings);
+	EXPECT(thick.size() > thin.size() + 8, true);
+
+	// nearly straight joins are always a single pair
+	std::vector<Vec2f> straight = {{0.f, 0.f}, {100.f, 0.f}, {200.f, 0.01f}};
+	EXPECT(stroke(straight, settings).size(), 10u);
+
+	// loops close with the first pair of the first join
+	std::vector<Vec2f> square = {{0.f, 0.f}, {10.f, 0.f}, {10.f, 10.f},
+		{0.f, 10.f}};
+	settings = {2.f, true};
+	settings.join = LineJoin::bevel;
+	auto loop = stroke(square, settings);
+	EXPECT(loop.size(), 4u * 4u + 2u);
+	EXPECT(loop.front() == loop[loop.size() - 2], true);
+	EXPECT(loop[1] == loop.back(), true);
+}
+
+TEST(caps) {
+	using ktc::LineCap;
+
+	std::vector<Vec2f> line = {{0.f, 0.f}, {10.f, 0.f}};
+	auto settings = ktc::StrokeSettings {4.f, false};
+	auto half = 0.5f * (settings.width + settings.fringe);
+
+	auto extent = [&]{
+		auto vertices = stroke(line, settings);
+		EXPECT(vertices.size(), ktc::strokeVertexCount(line, settings));
+		auto min = 0.f, max = 0.f;
+		for(auto& v : vertices) {
+			min = std::min(min, v.position.x);
+			max = std::max(max, v.position.x);
+		}
+		return std::pair{min, max};
+	};
+
+	auto expectExtent = [&](float min, float max) {
+		auto [emin, emax] = extent();
+		EXPECT(emin, min);
+		EXPECT(emax, max);
+	};
+
+	// butt and square caps: the fringe is centered on the end
+	settings.cap = LineCap::butt;
+	EXPECT(stroke(line, settings).size(), 8u);
+	expectExtent(-0.5f, 10.5f);
+
+	settings.cap = LineCap::square;
+	EXPECT(stroke(line, settings).size(), 8u);
+	expectExtent(-2.5f, 12.5f);
+
+	settings.capFringe = 0.f;
+	EXPECT(stroke(line, settings).size(), 4u);
+	expectExtent(-2.f, 12.f);
+
+	settings.cap = LineCap::butt;
+	EXPECT(stroke(line, settings).size(), 4u);
+	expectExtent(0.f, 10.f);
+
+	// round caps: fans around the center with the arc on the circle
+	settings.cap = LineCap::round;
+	auto round = stroke(line, settings);
+	EXPECT(round.size() > 8u, true);
+	for(auto& v : round) {
+		EXPECT(distance(line, v.position) <= half + 0.01f, true);
+		if(v.position.x < 0.f) {
+			EXPECT(std::abs(length(v.position) - half) < 0.01f, true);
+			EXPECT(v.aa.y, 1.f);
+		}
+	}
+
+	auto [min, max] = extent();
+	EXPECT(std::abs(min + half) < 0.01f, true);
+	EXPECT(std::abs(max - 10.f - half) < 0.01f, true);
+
+	// the center moves with extrude
+	settings.extrude = 1.f;
+	auto extruded = stroke(line, settings);
+	auto center = extruded[0].position;
+	EXPECT(extruded[0].aa.y, 0.f);
+	EXPECT(std::abs(std::abs(center.y) - 0.5f * settings.width) < 0.01f, true);
+	for(auto& v : extruded) {
+		if(v.position.x < 0.f) {
+			EXPECT(std::abs(length(v.position - center) - half) < 0.01f, true);
+		}
+	}
+
+	settings.extrude = 0.f;
+	settings.width = 100.f;
+	EXPECT(stroke(line, settings).size() > round.size() + 8, true);
+}
+
+TEST(dashes) {
+	std::vector<Vec2f> line = {{0.f, 0.f}, {10.f, 0.f}};
+	auto settings = ktc::StrokeSettings {2.f, false};
+	settings.capFringe = 0.f; // 4 vertices per straight dash
+
+	auto dashed = [&](Span<const Vec2f> points, std::vector<float> array,
+			float offset = 0.f) {
+		std::vector<ktc::Vertex> ret;
+		auto dash = ktc::DashPattern {array, offset};
+		ktc::bakeDashedStroke(points, settings, dash,
+			[&](const ktc::Vertex& v) { ret.push_back(v); });
+		EXPECT(ret.size(), ktc::dashedStrokeVertexCount(points, settings, dash));
+		return ret;
+	};
+
+	// dashes [0, 2], [3, 5], [6, 8], [9, 10], separated by 2 vertices
+	auto vertices = dashed(line, {2.f, 1.f});
+	EXPECT(vertices.size(), 4 * 4u + 3 * 2u);
+	EXPECT(vertices[3] == vertices[4], true);
+	EXPECT(vertices[5] == vertices[6], true);
+	for(auto& v : vertices) {
+		auto x = v.position.x;
+		EXPECT(x >= 0.f && x <= 10.f, true);
+		EXPECT(std::fmod(x, 3.f) <= 2.f + 0.001f, true);
+	}
+
+	// offsets move into the pattern, odd patterns are repeated
+	EXPECT(dashed(line, {2.f, 1.f}, 1.f).size(), 4 * 4u + 3 * 2u);
+	EXPECT(dashed(line, {2.f, 1.f}, -1.f).size(), 3 * 4u + 2 * 2u);
+	EXPECT(dashed(line, {2.f}).size(), 3 * 4u + 2 * 2u);
+	EXPECT(dashed(line, {2.f}, 2.f).size(), 2 * 4u + 1 * 2u);
+
+	// zero length dashes are omitted, invalid patterns stroke everything
+	EXPECT(dashed(line, {0.f, 2.f}).size(), 0u);
+	EXPECT(dashed(line, {}) == stroke(line, settings), true);
+	EXPECT(dashed(line, {0.f, 0.f}) == stroke(line, settings), true);
+	EXPECT(dashed(line, {2.f, -1.f}) == stroke(line, settings), true);
+
+	// unless they have square or round caps, like in svg.
+	// Dots at 0, 2, 4, 6, 8
+	settings.cap = ktc::LineCap::square;
+	auto dots = dashed(line, {0.f, 2.f});
+	EXPECT(dots.size(), 5 * 4u + 4 * 2u);
+	EXPECT(dots[0].position.x, -1.f);
+	EXPECT(dots[3].position.x, 1.f);
+	settings.cap = ktc::LineCap::round;
+	EXPECT(dashed(line, {0.f, 2.f}).size() > dots.size(), true);
+	settings.cap = ktc::LineCap::butt;
+
+	// gaps below the float precision at their position still separate
+	// the dashes
+	std::vector<Vec2f> longLine = {{0.f, 0.f}, {10000.f, 0.f}};
+	EXPECT(dashed(longLine, {1000.f, 0.0001f}).size(), 10 * 4u + 9 * 2u);
+
+	// dashes continue around corners
+	std::vector<Vec2f> corner = {{0.f, 0.f}, {4.f, 0.f}, {4.f, 4.f}};
+	auto bent = dashed(corner, {6.f, 10.f});
+	EXPECT(bent.size(), 6u);
+	for(auto& v : bent) {
+		EXPECT(v.position.y <= 2.f + 0.001f, true);
+	}
+
+	// loops include the closing segment, the dashes are open
+	std::vector<Vec2f> square = {{0.f, 0.f}, {10.f, 0.f}, {10.f, 10.f},
+		{0.f, 10.f}};
+	settings.loop = true;
+	EXPECT(dashed(square, {5.f, 5.f}).size(), 4 * 4u + 3 * 2u);
+	EXPECT(dashed(square, {5.f, 5.f}, 2.5f).size(), 2 * 4u + 3 * 6u + 4 * 2u);
+}
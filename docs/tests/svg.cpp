@@ -1,7 +1,13 @@
 #include <bugged.hpp>
 #include <katachi/svg.hpp>
+#include <katachi/svgDocument.hpp>
 #include <nytl/approxVec.hpp>
 #include <dlg/dlg.hpp>
+#include <clocale>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
 
 using namespace nytl;
 
@@ -56,6 +62,18 @@ TEST(arc) {
 	EXPECT(arc.clockwise, false);
 }
 
+TEST(arcRotation) {
+	auto subpath = ktc::parseSvgSubpath("M 0 0 a25,100 -30 0,1 50,-25");
+	EXPECT(subpath.commands.size(), 1u);
+	EXPECT(subpath.commands[0].to, id(Vec {50.f, -25.f}));
+
+	auto& arc = std::get<ktc::ArcParams>(subpath.commands[0].params);
+	EXPECT(arc.radius, id(Vec {25.f, 100.f}));
+	EXPECT(std::abs(arc.rotation + 0.5235988f) < 1e-6f, true);
+	EXPECT(arc.largeArc, false);
+	EXPECT(arc.clockwise, true);
+}
+
 TEST(paths) {
 	auto pathstring = "M 10,10 L 20,20 M 30,3e1 h 10 z l10 10";
 	auto paths = ktc::parseSvgPath(pathstring);
@@ -77,13 +95,303 @@ TEST(paths) {
 	EXPECT(s2.commands[0].params.index(), 0u);
 
 	auto& s3 = paths.subpaths[2];
-	EXPECT(s3.start, id(Vec {40.f, 30.f}));
+	EXPECT(s3.start, id(Vec {30.f, 30.f})); // start of the closed subpath
 	EXPECT(s3.closed, false);
 	EXPECT(s3.commands.size(), 1u);
-	EXPECT(s3.commands[0].to, id(Vec {50.f, 40.f}));
+	EXPECT(s3.commands[0].to, id(Vec {40.f, 40.f}));
 	EXPECT(s3.commands[0].params.index(), 0u);
 }
 
+TEST(relativeMove) {
+	// m is relative to the current point, the following coordinates
+	// are relative line commands
+	auto paths = ktc::parseSvgPath("M10 10 L20 20 m5 5 l1 1 2 2 Z m1 0 3 0");
+	EXPECT(paths.subpaths.size(), 3u);
+
+	auto& s2 = paths.subpaths[1];
+	EXPECT(s2.start, id(Vec {25.f, 25.f}));
+	EXPECT(s2.closed, true);
+	EXPECT(s2.commands.size(), 2u);
+	EXPECT(s2.commands[0].to, id(Vec {26.f, 26.f}));
+	EXPECT(s2.commands[1].to, id(Vec {28.f, 28.f}));
+
+	// after closing, the current point is the subpath start
+	auto& s3 = paths.subpaths[2];
+	EXPECT(s3.start, id(Vec {26.f, 25.f}));
+	EXPECT(s3.commands.size(), 1u);
+	EXPECT(s3.commands[0].to, id(Vec {29.f, 25.f}));
+
+	// an initial m is absolute
+	auto first = ktc::parseSvgPath("m5 5 l1 1");
+	EXPECT(first.subpaths.size(), 1u);
+	EXPECT(first.subpaths[0].start, id(Vec {5.f, 5.f}));
+}
+
+TEST(numbers) {
+	auto scan = [](const char* str, float& out) {
+		auto end = str + std::strlen(str);
+		return unsigned(ktc::scanSvgNumber(str, end, out) - str);
+	};
+
+	float f;
+	EXPECT(scan("1.5", f), 3u);
+	EXPECT(f, 1.5f);
+	EXPECT(scan("-0.25e2,", f), 7u);
+	EXPECT(f, -25.f);
+	EXPECT(scan(".5.5", f), 2u);
+	EXPECT(f, 0.5f);
+	EXPECT(scan("1e", f), 1u);
+	EXPECT(f, 1.f);
+	EXPECT(scan("+3.e-1", f), 6u);
+	EXPECT(std::abs(f - 0.3f) < 1e-7f, true);
+	EXPECT(scan("123456789012345678901234", f), 24u);
+	EXPECT(std::abs(f - 1.2345679e23f) < 1e16f, true);
+	EXPECT(scan("-", f), 0u);
+	EXPECT(scan(".", f), 0u);
+	EXPECT(scan("e5", f), 0u);
+
+	// compact forms
+	auto subpath = ktc::parseSvgSubpath("M1.5.5L-1-2.5.5.5h1e1v.5");
+	EXPECT(subpath.start, id(Vec {1.5f, 0.5f}));
+	EXPECT(subpath.commands.size(), 4u);
+	EXPECT(subpath.commands[0].to, id(Vec {-1.f, -2.5f}));
+	EXPECT(subpath.commands[1].to, id(Vec {0.5f, 0.5f}));
+	EXPECT(subpath.commands[2].to, id(Vec {10.5f, 0.5f}));
+	EXPECT(subpath.commands[3].to, id(Vec {10.5f, 1.f}));
+
+	// arc flags without separators
+	subpath = ktc::parseSvgSubpath("M0 0a10 10 0 0110 10");
+	EXPECT(subpath.commands.size(), 1u);
+	EXPECT(subpath.commands[0].to, id(Vec {10.f, 10.f}));
+	auto& arc = std::get<ktc::ArcParams>(subpath.commands[0].params);
+	EXPECT(arc.largeArc, false);
+	EXPECT(arc.clockwise, true);
+
+	// must not depend on the locale
+	if(std::setlocale(LC_ALL, "de_DE.UTF-8")) {
+		subpath = ktc::parseSvgSubpath("M 1.5 2.25");
+		EXPECT(subpath.start, id(Vec {1.5f, 2.25f}));
+		std::setlocale(LC_ALL, "C");
+	}
+}
+
+TEST(longData) {
+	// whitespace and digit runs of varying length crossing the blocks
+	// the parser classifies at once
+	std::string str = "M 0 0";
+	std::vector<Vec2f> expected;
+	for(auto i = 0u; i < 1000u; ++i) {
+		auto y = i * 1000003u % 100000u;
+		str += (i % 3u) ? " L" : "L";
+		str += std::string(i % 19u, ' ');
+		str += "000000000" + std::to_string(i) + ".5";
+		str += (i % 2u) ? std::string(",") : std::string(i % 70u, '\n');
+		str += "-" + std::to_string(y) + "0000000000e-10";
+		expected.push_back({i + 0.5f, -float(y)});
+	}
+
+	auto subpath = ktc::parseSvgSubpath(str);
+	EXPECT(subpath.commands.size(), expected.size());
+	auto same = true;
+	for(auto i = 0u; i < expected.size(); ++i) {
+		same &= (subpath.commands[i].to == expected[i]);
+	}
+	EXPECT(same, true);
+
+	float f;
+	auto num = std::string("0.1234567890123456789");
+	auto end = ktc::scanSvgNumber(num.data(), num.data() + num.size(), f);
+	EXPECT(end, num.data() + num.size());
+	EXPECT(std::abs(f - 0.12345679f) < 1e-8f, true);
+}
+
+TEST(bounds) {
+	// parse in place from a larger buffer, no null-termination
+	const char buffer[] = "<path d=\"M 10 20 L 30 40 h 5\"/>";
+	auto begin = std::strchr(buffer, '"') + 1;
+	auto end = std::strchr(begin, '"');
+	auto d = std::string_view(begin, end - begin);
+
+	auto subpath = ktc::parseSvgSubpath(d);
+	EXPECT(subpath.start, id(Vec {10.f, 20.f}));
+	EXPECT(subpath.commands.size(), 2u);
+	EXPECT(subpath.commands[1].to, id(Vec {35.f, 40.f}));
+
+	// the number must not be continued past the end
+	subpath = ktc::parseSvgSubpath(std::string_view("M 1 2 L 3 45", 11));
+	EXPECT(subpath.commands[0].to, id(Vec {3.f, 4.f}));
+
+	std::optional<ktc::SvgError> error;
+	ktc::parseSvgSubpath(std::string_view("L 10 20", 4), error);
+	EXPECT(error.has_value(), true);
+	EXPECT(error.value().type, ktc::SvgErrorType::incomplete);
+	EXPECT(error.value().pos, 4u);
+
+	// trailing whitespace
+	auto path = ktc::parseSvgPath("M 0 0 L 1 1 Z \n ");
+	EXPECT(path.subpaths.size(), 1u);
+	EXPECT(path.subpaths[0].closed, true);
+}
+
+// Records all segments as strings
+struct RecordingSink {
+	std::vector<std::string> segments;
+
+	void add(char c, std::initializer_list<Vec2f> points) {
+		std::string str(1, c);
+		for(auto p : points) {
+			str += " " + std::to_string(p.x) + "," + std::to_string(p.y);
+		}
+		segments.push_back(str);
+	}
+
+	void moveTo(Vec2f to) { add('M', {to}); }
+	void lineTo(Vec2f to) { add('L', {to}); }
+	void quadTo(Vec2f c, Vec2f to) { add('Q', {c, to}); }
+	void cubicTo(Vec2f c1, Vec2f c2, Vec2f to) { add('C', {c1, c2, to}); }
+	void arcTo(const ktc::ArcParams& arc, Vec2f to) {
+		add(arc.largeArc ? 'A' : 'a', {arc.radius, to});
+	}
+	void close() { add('Z', {}); }
+};
+
+TEST(visit) {
+	RecordingSink sink;
+	auto error = ktc::visitSvgPath(
+		"M10 10 20 10Q30 0 40 10T60 10c10 0 10 10 20 10s10 10 20 10Z"
+		"h5 M0 0a5 5 0 1 0 10 0", sink);
+	EXPECT(error.has_value(), false);
+
+	auto& segs = sink.segments;
+	EXPECT(segs.size(), 11u);
+	EXPECT(segs[0], std::string("M 10.000000,10.000000"));
+	EXPECT(segs[1], std::string("L 20.000000,10.000000")); // implicit line
+	EXPECT(segs[3], std::string("Q 50.000000,20.000000 60.000000,10.000000"));
+	EXPECT(segs[5], std::string("C 90.000000,20.000000 " // resolved
+		"90.000000,30.000000 100.000000,30.000000"));
+	EXPECT(segs[6], std::string("Z"));
+	EXPECT(segs[7], std::string("M 10.000000,10.000000")); // after close
+	EXPECT(segs[8], std::string("L 15.000000,10.000000"));
+	EXPECT(segs[10], std::string("A 5.000000,5.000000 10.000000,0.000000"));
+
+	// chunked input gives the same results, independent of chunk size
+	auto str = std::string(
+		"M 1.5,2.5 L-1-2.5.5.5 h1e1 v.5 q 1 1 2 2 t 3 3 "
+		"C 1 2 3 4 5 6 S 7 8 9 10 A 10 20 30 1 0 40 50 z l 1 1");
+	RecordingSink whole;
+	EXPECT(ktc::visitSvgPath(str, whole).has_value(), false);
+	for(auto size : {1u, 2u, 3u, 7u, 64u}) {
+		RecordingSink chunked;
+		ktc::SvgPathSinkAdapter<RecordingSink> adapter(chunked);
+		ktc::SvgPathStream stream(adapter);
+		for(auto i = 0u; i < str.size(); i += size) {
+			EXPECT(stream.feed(std::string_view(str).substr(i, size)), true);
+		}
+		EXPECT(stream.finish(), true);
+		EXPECT(chunked.segments == whole.segments, true);
+	}
+
+	// error positions refer to the whole input
+	RecordingSink errorSink;
+	ktc::SvgPathSinkAdapter<RecordingSink> adapter(errorSink);
+	ktc::SvgPathStream stream(adapter);
+	EXPECT(stream.feed("M 0 0 L 1"), true);
+	EXPECT(stream.feed(" 1 X 2"), false);
+	EXPECT(stream.error().value().type, ktc::SvgErrorType::invalidCommand);
+	EXPECT(stream.error().value().pos, 12u);
+	EXPECT(errorSink.segments.size(), 2u);
+}
+
+TEST(flatten) {
+	auto str = "M 10 10 L 100 10 Q 150 50 100 100 T 50 150 Z "
+		"c 10 20 30 40 50 60 s 10 20 -30 40 M 0 0 Z "
+		"M 200 200 a 50 20 30 1 1 100 0 h 20";
+
+	auto transform = ktc::Transform {{2.f, 0.f}, {0.5f, 1.f}, {5.f, 5.f}};
+	auto expected = ktc::flatten(ktc::parseSvgPath(str), {}, transform);
+	auto fused = ktc::flattenSvgPath(str, {}, transform);
+	EXPECT(fused.offsets == expected.offsets, true);
+	EXPECT(fused.points.size(), expected.points.size());
+
+	auto same = true;
+	for(auto i = 0u; i < expected.points.size(); ++i) {
+		same &= (fused.points[i] == expected.points[i]);
+	}
+	EXPECT(same, true);
+
+	ktc::FlattenedPath out;
+	auto error = ktc::flattenSvgPath("M 0 0 L 10 10 Q 5", out);
+	EXPECT(error.has_value(), true);
+	EXPECT(error.value().type, ktc::SvgErrorType::incomplete);
+	EXPECT(out.points.empty(), true);
+	ERROR(ktc::flattenSvgPath("M 0 0 X"), ktc::SvgException);
+}
+
+TEST(document) {
+	auto doc = R"svg(<?xml version="1.0"?>
+<svg xmlns="http://www.w3.org/2000/svg" viewBox="0 0 100 100">
+	<!-- <path d="M 0 0 L 1 1"/> is commented out -->
+	<g transform="translate(1 1)">
+		<path id="first" d="M 10 10 L 20 20 Z"/>
+		<svg:rect x="5" y = '6' width="10" height="20" rx="2" />
+		<circle cx="50" cy="50" r="10"></circle>
+		<ellipse cx="1" cy="2" rx="0" ry="3"/>
+		<polygon id="tri" points="0,0 10,0 5 10 7"/>
+		<polyline points="1 2 3 4"/>
+		<line x1="0" y1="1" x2="2" y2="3"/>
+		<path id="broken" d="M 0 0 L 1"/>
+	</g>
+	<text>a > b</text>
+</svg>)svg";
+
+	ktc::ThreadPool pool(3);
+	auto elements = ktc::loadSvgDocument(doc, pool.executor());
+	EXPECT(elements.size(), 8u);
+
+	EXPECT(elements[0].type, ktc::SvgElementType::path);
+	EXPECT(elements[0].id, std::string("first"));
+	EXPECT(elements[0].path.subpaths.size(), 1u);
+	EXPECT(elements[0].path.subpaths[0].closed, true);
+
+	auto& rect = elements[1].path.subpaths;
+	EXPECT(elements[1].type, ktc::SvgElementType::rect);
+	EXPECT(rect.size(), 1u);
+	EXPECT(rect[0].start, id(Vec {7.f, 6.f}));
+	EXPECT(rect[0].commands.size(), 8u);
+	EXPECT(rect[0].commands[1].to, id(Vec {15.f, 8.f}));
+
+	// circle consists of two arcs
+	auto points = ktc::flatten(elements[2].path.subpaths[0]);
+	auto maxDist = 0.f;
+	for(auto p : points) {
+		auto d = p - Vec {50.f, 50.f};
+		maxDist = std::max(maxDist, std::abs(std::sqrt(d.x * d.x + d.y * d.y) - 10.f));
+	}
+	EXPECT(maxDist < 0.3f, true);
+
+	EXPECT(elements[3].path.subpaths.empty(), true); // invalid radius
+	EXPECT(elements[4].id, std::string("tri"));
+	EXPECT(elements[4].path.subpaths[0].commands.size(), 2u);
+	EXPECT(elements[4].path.subpaths[0].closed, true);
+	EXPECT(elements[5].path.subpaths[0].closed, false);
+	EXPECT(elements[6].path.subpaths[0].commands[0].to, id(Vec {2.f, 3.f}));
+	EXPECT(elements[7].error.has_value(), true);
+	EXPECT(elements[7].error.value().type, ktc::SvgErrorType::incomplete);
+
+	// from a file
+	auto filename = "katachi_test_document.svg";
+	auto file = std::fopen(filename, "wb");
+	EXPECT(file != nullptr, true);
+	std::fwrite(doc, 1, std::strlen(doc), file);
+	std::fclose(file);
+
+	auto loaded = ktc::loadSvgFile(filename);
+	std::remove(filename);
+	EXPECT(loaded.size(), elements.size());
+	EXPECT(loaded[4].id, std::string("tri"));
+	ERROR(ktc::loadSvgFile("katachi_nonexistent.svg"), std::runtime_error);
+}
+
 TEST(errors) {
 	auto str1 = "M10,10Zh10";
 	ERROR(ktc::parseSvgSubpath(str1), ktc::SvgException);
@@ -0,0 +1,72 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <katachi/fwd.hpp>
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+namespace ktc {
+
+/// Linear memory resource for transient allocations, e.g. all paths and
+/// flattened points of a frame. Allocation just advances an offset into
+/// a memory block, deallocation does nothing. All memory is reclaimed at
+/// once via reset, which keeps the blocks for reuse, so after a few
+/// frames no more upstream allocations happen.
+/// Not threadsafe: every (worker) thread should use its own arena, which
+/// also avoids any contention in the global allocator.
+/// Can be used with all allocator-aware katachi types, e.g.
+/// `ktc::Path path(&arena)` or `ktc::FlattenedPath flat(&arena)`.
+class FrameArena : public std::pmr::memory_resource {
+public:
+	static constexpr std::size_t defaultBlockSize = 64 * 1024;
+
+public:
+	/// Blocks will have at least the given size, larger allocations
+	/// get their own block. Blocks are allocated from upstream.
+	explicit FrameArena(std::size_t blockSize = defaultBlockSize,
+		std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+	~FrameArena();
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	/// Invalidates all memory allocated from this arena. O(1), the
+	/// memory blocks are kept and reused by following allocations.
+	void reset();
+
+	/// Like reset but also returns all blocks to upstream.
+	void release();
+
+	/// Returns the number of bytes allocated since the last reset
+	/// (including alignment padding).
+	std::size_t used() const { return used_; }
+
+	/// Returns the size of all owned blocks.
+	std::size_t capacity() const { return capacity_; }
+
+protected:
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+	void do_deallocate(void*, std::size_t, std::size_t) override {}
+	bool do_is_equal(const std::pmr::memory_resource& other)
+		const noexcept override;
+
+protected:
+	struct Block {
+		std::byte* data;
+		std::size_t size;
+	};
+
+	std::pmr::memory_resource* upstream_;
+	std::size_t blockSize_;
+	std::vector<Block> blocks_;
+	std::size_t block_ {}; // index of the current block
+	std::size_t offset_ {}; // offset in the current block
+	std::size_t used_ {};
+	std::size_t capacity_ {};
+};
+
+} // namespace ktc
@@ -0,0 +1,136 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <katachi/fwd.hpp>
+#include <katachi/compactPath.hpp>
+#include <katachi/mappedFile.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ktc {
+
+// Binary path format: a collection of named paths in CompactPath
+// representation, stored so that it can be used directly from a
+// memory mapping. All values are 32-bit in native (little endian)
+// byte order, offsets are global over all paths.
+//  - header (BinaryPathHeader)
+//  - path index: pathCount + 1 first subpath indices
+//  - subpath ranges: subpathCount BinarySubpathRange
+//  - points: pointCount * 2 floats
+//  - arc rotations: arcCount floats
+//  - name offsets: pathCount + 1 offsets into the names
+//  - verbs: verbCount bytes (Verb)
+//  - names: concatenated names, not null-terminated
+
+struct BinaryPathHeader {
+	static constexpr std::uint32_t magicValue = 0x5043544Bu; // "KTCP"
+	static constexpr std::uint32_t currentVersion = 1u;
+	static constexpr std::uint32_t byteOrderValue = 0x01020304u;
+
+	std::uint32_t magic;
+	std::uint32_t version;
+	std::uint32_t byteOrder;
+	std::uint32_t pathCount;
+	std::uint32_t subpathCount;
+	std::uint32_t verbCount;
+	std::uint32_t pointCount;
+	std::uint32_t arcCount;
+	std::uint32_t nameSize;
+};
+
+struct BinarySubpathRange {
+	std::uint32_t verb;
+	std::uint32_t point;
+	std::uint32_t arcRotation;
+	std::uint32_t closed;
+};
+
+/// Collects paths and serializes them into the binary path format.
+class BinaryPathWriter {
+public:
+	/// Adds the given path with the given name. Names don't have to
+	/// be unique. Returns the index of the path.
+	unsigned add(const Path&, std::string_view name = {});
+	unsigned add(const CompactPath&, std::string_view name = {});
+
+	/// Returns the number of added paths.
+	unsigned size() const { return unsigned(pathSubpaths_.size()); }
+
+	/// Returns the serialized data.
+	std::vector<std::byte> serialize() const;
+
+	/// Writes the serialized data into the given file.
+	/// Throws std::runtime_error on failure.
+	void write(const char* filename) const;
+
+protected:
+	unsigned addName(std::string_view name);
+
+protected:
+	CompactPath paths_; // subpaths of all paths
+	std::vector<std::uint32_t> pathSubpaths_; // first subpath of each path
+	std::string names_;
+	std::vector<std::uint32_t> nameOffsets_;
+};
+
+/// Reader of the binary path format.
+/// Validates the data once on construction, after that the paths can
+/// be used without any parsing or copying, directly from the mapping.
+class BinaryPathFile {
+public:
+	/// Maps the given file. Throws std::runtime_error if it can't
+	/// be read or contains invalid data.
+	explicit BinaryPathFile(const char* filename);
+
+	/// Uses the given data, which must stay valid and be aligned to
+	/// at least 4 bytes. Throws std::runtime_error for invalid data.
+	explicit BinaryPathFile(Span<const std::byte> data);
+
+	/// Returns the number of paths.
+	unsigned size() const { return header_->pathCount; }
+
+	/// Returns the name of the given path.
+	std::string_view name(unsigned path) const;
+
+	/// Returns the index of the first path with the given name.
+	std::optional<unsigned> find(std::string_view name) const;
+
+	/// Returns the number of subpaths of the given path.
+	unsigned subpathCount(unsigned path) const;
+
+	/// Returns a view of the i-th subpath of the given path, pointing
+	/// directly into the data.
+	CompactSubpath subpath(unsigned path, unsigned i) const;
+
+	/// Copies the given path into a Path.
+	Path path(unsigned path) const;
+
+protected:
+	void init(const std::byte* data, std::size_t size);
+
+protected:
+	MappedFile file_;
+	const BinaryPathHeader* header_ {};
+	const std::uint32_t* pathSubpaths_ {};
+	const BinarySubpathRange* subpaths_ {};
+	const Vec2f* points_ {};
+	const float* arcRotations_ {};
+	const std::uint32_t* nameOffsets_ {};
+	const Verb* verbs_ {};
+	const char* names_ {};
+};
+
+/// Flattens all subpaths of the given path of the file, like the
+/// Path overload (path.hpp).
+void flatten(const BinaryPathFile&, unsigned path, FlattenedPath& out,
+	const FlattenSettings& = {}, const Transform& = {},
+	const ParallelForFn& parallelFor = {});
+
+} // namespace ktc
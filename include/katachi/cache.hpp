@@ -0,0 +1,115 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <katachi/fwd.hpp>
+#include <katachi/path.hpp>
+#include <nytl/vec.hpp>
+#include <nytl/span.hpp>
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace ktc {
+
+/// Returns a hash of the contents (start, closed, commands) of the
+/// given subpath. Equal subpaths have equal hashes.
+std::uint64_t contentHash(const Subpath&);
+
+/// Returns a hash of the given settings.
+std::uint64_t contentHash(const FlattenSettings&);
+
+/// Counters of a FlattenCache, can be used to size it.
+struct FlattenCacheStats {
+	std::uint64_t hits {};
+	std::uint64_t misses {};
+	std::uint64_t evictions {};
+	std::size_t entries {}; /// Number of currently cached subpaths
+	std::size_t bytes {}; /// Current (approximate) memory usage
+};
+
+/// Memoizes the results of flattening subpaths.
+/// Entries are keyed by the content hash of the subpath, the flatten
+/// settings and a quantized scale bucket. Every entry stores a copy of
+/// its subpath and settings, a hit is only returned when they are equal
+/// to the requested ones, so hash collisions can't return the points of
+/// another subpath. When the memory budget is exceeded, the least
+/// recently used entries are evicted.
+/// Not threadsafe, every thread should use its own cache.
+class FlattenCache {
+public:
+	/// Number of scale buckets per doubling of the scale.
+	static constexpr auto bucketsPerOctave = 4u;
+
+public:
+	/// Creates the cache with the given memory budget in bytes.
+	explicit FlattenCache(std::size_t maxBytes = 16 * 1024 * 1024);
+
+	/// Returns the flattened points of the given subpath in its local
+	/// space, suitable to be drawn with a transform that scales lengths
+	/// by the given factor (e.g. maxScale(transform)).
+	/// The scale is rounded up to the next bucket and the tolerances
+	/// divided by it, so the result is at least as precise as
+	/// flatten(subpath, settings, transform).
+	/// The returned span is valid until the next call to flatten, clear
+	/// or maxBytes.
+	Span<const Vec2f> flatten(const Subpath&, const FlattenSettings& = {},
+		float scale = 1.f);
+
+	/// Like the overload above but takes the precomputed contentHash
+	/// of the subpath, for static subpaths that don't have to be hashed
+	/// every time. Hits still compare the subpath with the cached one.
+	Span<const Vec2f> flatten(const Subpath&, std::uint64_t subpathHash,
+		const FlattenSettings& = {}, float scale = 1.f);
+
+	/// Removes all entries. Does not reset the statistics.
+	void clear();
+
+	/// Changes the memory budget, evicts entries if needed.
+	void maxBytes(std::size_t);
+	std::size_t maxBytes() const { return maxBytes_; }
+
+	const FlattenCacheStats& stats() const { return stats_; }
+
+	/// Resets the hit, miss and eviction counters.
+	void resetStats();
+
+protected:
+	struct Key {
+		std::uint64_t subpath;
+		std::uint64_t settings;
+		int scaleBucket;
+
+		bool operator==(const Key& o) const {
+			return subpath == o.subpath && settings == o.settings &&
+				scaleBucket == o.scaleBucket;
+		}
+	};
+
+	struct KeyHash {
+		std::size_t operator()(const Key&) const;
+	};
+
+	struct Entry {
+		Key key;
+		Subpath subpath; // to verify hits
+		FlattenSettings settings;
+		std::vector<Vec2f> points;
+		std::size_t bytes;
+	};
+
+	void evict(std::size_t keep);
+
+protected:
+	std::size_t maxBytes_;
+	FlattenCacheStats stats_;
+	std::list<Entry> entries_; // most recently used first
+	std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> map_;
+};
+
+} // namespace ktc
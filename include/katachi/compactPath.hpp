@@ -0,0 +1,138 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <katachi/fwd.hpp>
+#include <katachi/path.hpp>
+#include <nytl/vec.hpp>
+#include <nytl/span.hpp>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace ktc {
+
+/// The kind of a CompactPath segment.
+/// Every verb consumes a fixed number of points from the point stream,
+/// given in the comments. Arcs additionally consume one entry of the
+/// arcRotations stream, their flags are encoded into the verb.
+enum class Verb : std::uint8_t {
+	line, // to
+	qBezier, // control, to
+	sqBezier, // to
+	cBezier, // control1, control2, to
+	scBezier, // control2, to
+	arc, // radius, to
+	arcLarge,
+	arcClockwise,
+	arcLargeClockwise,
+};
+
+/// Returns the number of points the given verb consumes.
+constexpr unsigned pointCount(Verb verb) {
+	switch(verb) {
+		case Verb::line: return 1u;
+		case Verb::sqBezier: return 1u;
+		case Verb::cBezier: return 3u;
+		default: return 2u;
+	}
+}
+
+/// Returns whether the given verb is one of the arc verbs.
+constexpr bool isArc(Verb verb) {
+	return verb >= Verb::arc;
+}
+
+/// Non-owning view of a single subpath of a CompactPath.
+/// The first point is the start point of the subpath, followed by
+/// the points of its verbs.
+struct CompactSubpath {
+	Span<const Verb> verbs;
+	Span<const Vec2f> points;
+	Span<const float> arcRotations;
+	bool closed {};
+};
+
+/// Alternative representation of Path that stores all segments
+/// in flat streams shared by all subpaths: one byte per segment plus
+/// only the points it actually needs instead of a Command per segment.
+/// Cheaper to store and faster to walk than Path, but cannot be
+/// modified in place. Allocator-aware like Path.
+class CompactPath {
+public:
+	/// Where a subpath starts in the streams. Ends where the next
+	/// subpath starts or at the end of the streams.
+	struct SubpathRange {
+		unsigned verb {}; // offset of the first verb
+		unsigned point {}; // offset of the start point
+		unsigned arcRotation {}; // offset of the first arc rotation
+		bool closed {};
+	};
+
+	using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+	std::pmr::vector<Verb> verbs;
+	std::pmr::vector<Vec2f> points;
+	std::pmr::vector<float> arcRotations; // x-axis rotations in radians
+	std::pmr::vector<SubpathRange> subpaths;
+
+public:
+	CompactPath() = default;
+	explicit CompactPath(const allocator_type& alloc) :
+		verbs(alloc), points(alloc), arcRotations(alloc), subpaths(alloc) {}
+
+	/// Starts a new subpath at the given point.
+	/// All other commands are appended to the last subpath, so there
+	/// has to be one.
+	void move(Vec2f to);
+	void line(Vec2f to);
+	void arc(Vec2f to, const ArcParams&);
+	void qBezier(Vec2f to, const QBezierParams&);
+	void sqBezier(Vec2f to);
+	void cBezier(Vec2f to, const CBezierParams&);
+	void scBezier(Vec2f to, const SCBezierParams&);
+
+	/// Closes the last subpath.
+	void close();
+
+	/// Removes all subpaths, keeps the capacity of the streams.
+	void clear();
+
+	/// Returns the number of subpaths.
+	unsigned size() const { return unsigned(subpaths.size()); }
+
+	/// Returns a view of the i-th subpath.
+	CompactSubpath subpath(unsigned i) const;
+};
+
+/// Conversion between Path and CompactPath. The returned object
+/// allocates from the given memory resource.
+CompactPath compact(const Path&, std::pmr::memory_resource* =
+	std::pmr::get_default_resource());
+Path expand(const CompactPath&, std::pmr::memory_resource* =
+	std::pmr::get_default_resource());
+
+/// Appends the given subpath to the given CompactPath as a new subpath.
+void append(CompactPath&, const Subpath&);
+
+/// Converts a single subpath of a CompactPath to a Subpath.
+Subpath expand(const CompactSubpath&, std::pmr::memory_resource* =
+	std::pmr::get_default_resource());
+
+/// Flatten functions like the Subpath overloads (path.hpp), walking
+/// the compact streams directly.
+unsigned flattenedPointCount(const CompactSubpath&,
+	const FlattenSettings& = {}, const Transform& = {});
+unsigned flatten(const CompactSubpath&, Span<Vec2f> out,
+	const FlattenSettings& = {}, const Transform& = {});
+void flatten(const CompactSubpath&, std::vector<Vec2f>& out,
+	const FlattenSettings& = {}, const Transform& = {});
+
+/// Like the Path overload (path.hpp).
+void flatten(const CompactPath&, FlattenedPath& out,
+	const FlattenSettings& = {}, const Transform& = {},
+	const ParallelForFn& parallelFor = {});
+
+} // namespace ktc
@@ -6,6 +6,8 @@
 
 #include <katachi/fwd.hpp>
 #include <nytl/vec.hpp>
+#include <nytl/span.hpp>
+#include <memory_resource>
 #include <vector>
 
 namespace ktc {
@@ -26,11 +28,14 @@ struct CubicBezier {
 };
 
 /// All information needed to draw an arc when its center is known.
+/// The points of the arc are center + R(rotation) * (radius * (cos, sin)(a))
+/// for angle a from start to end, R being a rotation matrix.
 struct CenterArc {
 	Vec2f center;
 	Vec2f radius;
 	float start;
 	float end;
+	float rotation {}; // x-axis rotation of the ellipse in radians
 };
 
 /// All information needed to draw an arc when start- and end- points are known.
@@ -42,13 +47,104 @@ struct EndArc {
 	Vec2f radius;
 	bool largeArc;
 	bool clockwise;
+	float rotation {}; // x-axis rotation of the ellipse in radians
 };
 
-void flatten(const CubicBezier&, std::vector<Vec2f>&,
-	unsigned maxLevel = 8, float minDist = 0.001f);
-void flatten(const QuadBezier&, std::vector<Vec2f>&,
-	unsigned maxLevel = 10, float minDist = 0.001f);
-void flatten(const CenterArc&, std::vector<Vec2f>&, unsigned steps);
+/// Affine 2-dimensional transformation.
+/// Maps a point p to x * p.x + y * p.y + translation.
+/// Default-initialized it is the identity transform.
+struct Transform {
+	Vec2f x {1.f, 0.f}; /// image of the x axis (first matrix column)
+	Vec2f y {0.f, 1.f}; /// image of the y axis (second matrix column)
+	Vec2f translation {};
+
+	/// Returns the transform that first applies b and then a.
+	friend Transform operator*(const Transform& a, const Transform& b) {
+		return {
+			b.x.x * a.x + b.x.y * a.y,
+			b.y.x * a.x + b.y.y * a.y,
+			b.translation.x * a.x + b.translation.y * a.y + a.translation
+		};
+	}
+};
+
+/// Applies the given transform to the given point.
+Vec2f apply(const Transform&, Vec2f);
+
+/// Returns the maximum factor by which the given transform scales
+/// lengths, i.e. the largest singular value of its linear part.
+float maxScale(const Transform&);
+
+/// Returns the number of steps needed to flatten the given arc so
+/// that the distance between the resulting polyline and the arc is at
+/// most tolerance (in the units of the arc, e.g. pixels).
+/// If a transform is given, the tolerance refers to the transformed arc.
+unsigned flattenedPointCount(const CenterArc&, float tolerance,
+	const Transform& = {});
+
+/// Flattens the given arc into the given number of evenly spaced steps.
+/// Appends exactly steps points, the start point of the arc is not
+/// included. Only evaluates trigonometric functions once per call,
+/// the points are computed with a rotation recurrence.
+/// The given transform is applied to the generated points.
+void flatten(const CenterArc&, std::vector<Vec2f>&, unsigned steps,
+	const Transform& = {});
+
+/// Like the vector overload, but writes out.size() steps into out.
+void flatten(const CenterArc&, Span<Vec2f> out, const Transform& = {});
+
+/// Returns the number of points flatten will output for the given
+/// cubic bezier curve and tolerance.
+unsigned flattenedPointCount(const CubicBezier&, float tolerance);
+
+/// Flattens the given cubic bezier curve into line segments.
+/// The distance between the resulting polyline and the curve will be
+/// at most tolerance (in the units of the curve, e.g. pixels).
+/// The number of segments is determined analytically (Wang's formula),
+/// the points are evaluated using forward differencing.
+/// Appends exactly flattenedPointCount(bezier, tolerance) points, the
+/// start point of the curve is not included, the last point is the
+/// exact end point.
+void flatten(const CubicBezier&, std::vector<Vec2f>&, float tolerance = 0.25f);
+void flatten(const CubicBezier&, std::pmr::vector<Vec2f>&,
+	float tolerance = 0.25f);
+
+/// Like the vector overload, but writes the points into out, which must
+/// have space for at least flattenedPointCount(bezier, tolerance) points.
+/// Returns the number of written points.
+unsigned flatten(const CubicBezier&, Span<Vec2f> out, float tolerance = 0.25f);
+
+/// Returns the number of points flatten will output for the given
+/// quadratic bezier curve and tolerance.
+unsigned flattenedPointCount(const QuadBezier&, float tolerance);
+
+/// Flattens the given quadratic bezier curve into line segments.
+/// The distance between the resulting polyline and the curve will be
+/// at most tolerance (in the units of the curve, e.g. pixels).
+/// Appends exactly flattenedPointCount(bezier, tolerance) points, the
+/// start point of the curve is not included, the last point is the
+/// exact end point.
+/// See raphlinus.github.io/graphics/curves/2019/12/23/flatten-quadbez.html
+void flatten(const QuadBezier&, std::vector<Vec2f>&, float tolerance = 0.25f);
+void flatten(const QuadBezier&, std::pmr::vector<Vec2f>&,
+	float tolerance = 0.25f);
+
+/// Like the vector overload, but writes the points into out, which must
+/// have space for at least flattenedPointCount(bezier, tolerance) points.
+/// Returns the number of written points.
+unsigned flatten(const QuadBezier&, Span<Vec2f> out, float tolerance = 0.25f);
+
+/// Flattens multiple curves at once, using SIMD instructions (SSE2, NEON)
+/// where available. Semantics match the flatten overloads, points might
+/// differ slightly due to the different evaluation method.
+/// The points of all curves are written into points, offsets receives
+/// curves.size() + 1 entries: The points of the i-th curve are
+/// points[offsets[i]] up to (excluding) points[offsets[i + 1]].
+/// Both vectors are overwritten, their capacity is reused.
+void flattenBatch(Span<const CubicBezier>, std::vector<Vec2f>& points,
+	std::vector<unsigned>& offsets, float tolerance = 0.25f);
+void flattenBatch(Span<const QuadBezier>, std::vector<Vec2f>& points,
+	std::vector<unsigned>& offsets, float tolerance = 0.25f);
 
 CubicBezier quadToCubic(const QuadBezier&);
 CenterArc endToCenter(const EndArc&);
@@ -14,10 +14,13 @@ struct QuadBezier;
 struct CubicBezier;
 struct CenterArc;
 struct EndArc;
+struct Transform;
 
 struct Command;
 class Path;
 class Subpath;
+class CompactPath;
+struct CompactSubpath;
 
 enum class SvgErrorType;
 struct SvgError;
@@ -0,0 +1,42 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <katachi/fwd.hpp>
+#include <cstddef>
+#include <string_view>
+
+namespace ktc {
+
+/// Read-only view of the contents of a whole file.
+/// Maps the file into memory where possible (posix mmap), otherwise
+/// reads it into memory.
+class MappedFile {
+public:
+	MappedFile() = default;
+
+	/// Throws std::runtime_error if the file can't be opened or mapped.
+	explicit MappedFile(const char* filename);
+	~MappedFile();
+
+	MappedFile(MappedFile&& rhs) noexcept { swap(*this, rhs); }
+	MappedFile& operator=(MappedFile rhs) noexcept {
+		swap(*this, rhs);
+		return *this;
+	}
+
+	const char* data() const { return data_; }
+	std::size_t size() const { return size_; }
+	std::string_view view() const { return {data_, size_}; }
+
+	friend void swap(MappedFile& a, MappedFile& b) noexcept;
+
+protected:
+	const char* data_ {};
+	std::size_t size_ {};
+	bool mapped_ {}; // whether data_ was mapped or allocated
+};
+
+} // namespace ktc
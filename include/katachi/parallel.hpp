@@ -0,0 +1,72 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <katachi/fwd.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ktc {
+
+/// Executes job(i) for all i in [0, count), possibly in parallel, and
+/// only returns once all jobs have finished.
+/// Can be used to plug in an application-provided executor. Jobs may
+/// call the same executor again, implementations must not deadlock then
+/// (e.g. by executing such nested calls serially).
+using ParallelForFn = std::function<void(unsigned count,
+	const std::function<void(unsigned)>& job)>;
+
+/// Simple thread pool with a ParallelForFn interface.
+/// The calling thread participates in executing the jobs.
+/// Jobs must not throw.
+class ThreadPool {
+public:
+	/// Creates the pool with the given number of threads, including the
+	/// calling thread. 0 uses std::thread::hardware_concurrency.
+	explicit ThreadPool(unsigned threads = 0u);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/// Executes job(i) for all i in [0, count) on the threads of the pool.
+	/// Threadsafe, concurrent calls will be serialized. Nested calls from
+	/// within a job of this pool are executed serially on the calling
+	/// thread.
+	void parallelFor(unsigned count, const std::function<void(unsigned)>& job);
+
+	/// Returns a ParallelForFn executing on this pool.
+	/// Must not be used after the pool was destroyed.
+	ParallelForFn executor();
+
+	/// Returns the number of threads, including the calling thread.
+	unsigned threadCount() const { return unsigned(workers_.size()) + 1; }
+
+protected:
+	void work();
+	void runJobs();
+
+protected:
+	std::vector<std::thread> workers_;
+	std::mutex callMutex_; // serializes parallelFor calls
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	std::condition_variable doneCv_;
+	std::uint64_t generation_ {};
+	unsigned active_ {};
+	bool exit_ {};
+
+	const std::function<void(unsigned)>* job_ {};
+	unsigned count_ {};
+	std::atomic<unsigned> next_ {};
+};
+
+} // namespace ktc
@@ -5,6 +5,8 @@
 #pragma once
 
 #include <katachi/fwd.hpp>
+#include <katachi/curves.hpp>
+#include <katachi/parallel.hpp>
 
 #include <nytl/vec.hpp>
 #include <nytl/stringParam.hpp>
@@ -12,6 +14,7 @@
 
 #include <variant>
 #include <vector>
+#include <memory_resource>
 #include <cstddef>
 
 namespace ktc {
@@ -31,7 +34,8 @@ struct CBezierParams {
 struct ArcParams {
 	Vec2f radius;
 	bool largeArc {};
-    bool clockwise {};
+	bool clockwise {};
+	float rotation {}; // x-axis rotation of the ellipse in radians
 };
 
 /// Represents one subpath segment.
@@ -49,13 +53,33 @@ struct Command {
 };
 
 /// A continous path consisting of curve commands.
+/// Allocator-aware: when constructed with a memory resource (e.g. a
+/// FrameArena, arena.hpp) the commands are allocated from it.
 class Subpath {
 public:
+	using allocator_type = std::pmr::polymorphic_allocator<Command>;
+
 	Vec2f start {}; /// Starting point
 	bool closed {}; /// Whether the subpath is closed
-	std::vector<Command> commands {}; /// The commands defining the subpath
+	std::pmr::vector<Command> commands {}; /// The commands defining the subpath
 
 public:
+	Subpath() = default;
+	explicit Subpath(const allocator_type& alloc) : commands(alloc) {}
+	explicit Subpath(Vec2f startPoint, const allocator_type& alloc = {}) :
+		start(startPoint), commands(alloc) {}
+	Subpath(const Subpath& other, const allocator_type& alloc) :
+		start(other.start), closed(other.closed),
+		commands(other.commands, alloc) {}
+	Subpath(Subpath&& other, const allocator_type& alloc) :
+		start(other.start), closed(other.closed),
+		commands(std::move(other.commands), alloc) {}
+
+	Subpath(const Subpath&) = default;
+	Subpath(Subpath&&) = default;
+	Subpath& operator=(const Subpath&) = default;
+	Subpath& operator=(Subpath&&) = default;
+
 	Command& line(Vec2f to);
 	Command& arc(Vec2f to, const ArcParams&);
 	Command& qBezier(Vec2f to, const QBezierParams&);
@@ -65,36 +89,119 @@ public:
 };
 
 /// Collection of continous subpaths forming a Path that may contains jumps.
+/// Allocator-aware like Subpath, the memory resource is propagated to
+/// the subpaths.
 class Path {
 public:
-	std::vector<Subpath> subpaths;
+	using allocator_type = std::pmr::polymorphic_allocator<Subpath>;
+
+	std::pmr::vector<Subpath> subpaths;
+
+public:
+	Path() = default;
+	explicit Path(const allocator_type& alloc) : subpaths(alloc) {}
+	Path(const Path& other, const allocator_type& alloc) :
+		subpaths(other.subpaths, alloc) {}
+	Path(Path&& other, const allocator_type& alloc) :
+		subpaths(std::move(other.subpaths), alloc) {}
+
+	Path(const Path&) = default;
+	Path(Path&&) = default;
+	Path& operator=(const Path&) = default;
+	Path& operator=(Path&&) = default;
+
 	Subpath& move(Vec2f to);
 };
 
 /// Transform ArcParams into a CenterArc description (curves.hpp).
 /// The CenterArc description can be used to flatten the arc into points.
-CenterArc parseArc(Vec2f from, ArcParams&, Vec2f to);
+CenterArc parseArc(Vec2f from, const ArcParams&, Vec2f to);
 
 /// Defines various aspects (mainly precision) of the path flattening
-/// process.
+/// process. When flattening with a transform, the tolerances refer
+/// to the transformed (device) space.
+/// When adding members, update contentHash and the FlattenCache
+/// comparison in cache.cpp.
 struct FlattenSettings {
-	/// steps for baking an arc segment:
-	/// clamp(arcLengthFac * radius * dangle, minSteps, maxSteps)
-	float arcLengthFac = 0.2f; // roughly 1 segment per 5 pixels
+	/// Maximum distance between a flattened arc and the real arc.
+	/// The number of steps is additionally clamped into
+	/// [minArcSteps, maxArcSteps].
+	float arcTolerance = 0.25f;
 	unsigned minArcSteps = 4u;
 	unsigned maxArcSteps = 256u;
 
-	/// The maxLevel params passed to the flatten functions for bezier curves
-	unsigned maxQBezLevel = 8u;
-	float minQBezDist = 0.001f;
+	/// Maximum distance between a flattened quadratic bezier curve
+	/// and the real curve.
+	float qBezTolerance = 0.25f;
 
-	unsigned maxCBezLevel = 10u;
-	float minCBezDist = 0.001f;
+	/// Maximum distance between a flattened cubic bezier curve
+	/// and the real curve.
+	float cBezTolerance = 0.25f;
 };
 
 /// Flattens the given subpath into a point array.
 /// Note that if the subpath is closed, will append its first point
 /// as additional end point.
-std::vector<Vec2f> flatten(const Subpath&, const FlattenSettings& = {});
+/// The given transform is applied to the subpath while flattening it,
+/// i.e. the points will be in transformed space and the number of
+/// generated points depends on the size of the transformed subpath.
+std::vector<Vec2f> flatten(const Subpath&, const FlattenSettings& = {},
+	const Transform& = {});
+
+/// Returns the number of points flatten will output for the given
+/// subpath, settings and transform.
+unsigned flattenedPointCount(const Subpath&, const FlattenSettings& = {},
+	const Transform& = {});
+
+/// Like the vector returning overload but writes the points into the
+/// given span (e.g. mapped buffer memory) that must have space for at
+/// least flattenedPointCount(subpath, settings, transform) points.
+/// Returns the number of written points. Does not allocate.
+unsigned flatten(const Subpath&, Span<Vec2f> out, const FlattenSettings& = {},
+	const Transform& = {});
+
+/// Like the vector returning overload but appends the points to the
+/// given vector. When the vector is reused (e.g. cleared every frame)
+/// this will not allocate once its capacity is large enough.
+void flatten(const Subpath&, std::vector<Vec2f>& out,
+	const FlattenSettings& = {}, const Transform& = {});
+void flatten(const Subpath&, std::pmr::vector<Vec2f>& out,
+	const FlattenSettings& = {}, const Transform& = {});
+
+/// The flattened points of all subpaths of a path in one contiguous array.
+/// The points of the i-th subpath are points[offsets[i]] up to
+/// (excluding) points[offsets[i + 1]].
+/// Allocator-aware like Subpath.
+struct FlattenedPath {
+	using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+	std::pmr::vector<Vec2f> points;
+	std::pmr::vector<unsigned> offsets;
+
+	FlattenedPath() = default;
+	explicit FlattenedPath(const allocator_type& alloc) :
+		points(alloc), offsets(alloc) {}
+
+	/// Returns the number of subpaths.
+	unsigned size() const {
+		return offsets.empty() ? 0u : unsigned(offsets.size() - 1);
+	}
+
+	/// Returns the points of the i-th subpath.
+	Span<const Vec2f> subpath(unsigned i) const {
+		return {points.data() + offsets[i], offsets[i + 1] - offsets[i]};
+	}
+};
 
-} // namespace vgv
+/// Flattens all subpaths of the given path into out. Its vectors are
+/// overwritten, their capacity is reused.
+/// First computes the number of points of each subpath, then writes
+/// all subpaths directly into their final place. If a parallelFor
+/// executor (parallel.hpp) is given, the subpaths are processed in
+/// parallel on it.
+void flatten(const Path&, FlattenedPath& out, const FlattenSettings& = {},
+	const Transform& = {}, const ParallelForFn& parallelFor = {});
+FlattenedPath flatten(const Path&, const FlattenSettings& = {},
+	const Transform& = {}, const ParallelForFn& parallelFor = {});
+
+} // namespace ktc
@@ -0,0 +1,61 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <katachi/fwd.hpp>
+#include <array>
+#include <cstdint>
+
+namespace ktc {
+
+/// Counters describing the work done by flattening and baking, e.g. to
+/// find assets that produce pathological tessellation.
+/// They are only recorded when katachi is built with stats (meson
+/// option 'stats'), otherwise the recording is compiled out and all
+/// values stay zero. Code including the katachi headers must be built
+/// with the same KTC_STATS define, katachi_dep and the pkg-config file
+/// pass it on.
+struct Stats {
+	static constexpr auto histogramSize = 12u;
+	using Histogram = std::array<std::uint64_t, histogramSize>;
+
+	/// Number of segments curves were flattened into. Bucket i counts
+	/// the curves with [2^i, 2^(i+1)) segments, the last bucket
+	/// additionally all curves with more segments.
+	Histogram quadSegments {};
+	Histogram cubicSegments {};
+	Histogram arcSteps {};
+
+	/// Flattened points output per segment type, including the
+	/// start and closing points of subpaths in linePoints.
+	std::uint64_t linePoints {};
+	std::uint64_t quadPoints {};
+	std::uint64_t cubicPoints {};
+	std::uint64_t arcPoints {};
+
+	/// Points skipped by the stroke and fill functions since they were
+	/// equal to one of their neighbors.
+	std::uint64_t degeneratePoints {};
+
+	/// Vertices output by the stroke and fill functions.
+	std::uint64_t strokeVertices {};
+	std::uint64_t fillVertices {};
+};
+
+/// Returns whether katachi was built with stats.
+bool statsEnabled();
+
+/// Returns the stats recorded by the calling thread since its last
+/// reset. Note that work done on other threads (e.g. by a parallelFor
+/// executor) is recorded in the stats of those threads.
+const Stats& threadStats();
+
+/// Resets the stats of the calling thread.
+void resetThreadStats();
+
+/// Adds the counters of b to a, e.g. to combine the stats of threads.
+Stats& operator+=(Stats& a, const Stats& b);
+
+} // namespace ktc
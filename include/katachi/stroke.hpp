@@ -5,20 +5,37 @@
 #pragma once
 
 #include <katachi/fwd.hpp>
+#include <nytl/span.hpp>
 #include <nytl/vec.hpp>
 #include <vector>
 #include <functional>
+#include <memory_resource>
+#include <type_traits>
 
 namespace ktc {
 
+/// How two segments of a stroke are joined, see svg stroke-linejoin.
+enum class LineJoin {
+	miter,
+	bevel,
+	round,
+};
+
+/// How the start and end of strokes are drawn, see svg stroke-linecap.
+enum class LineCap {
+	butt,
+	square,
+	round,
+};
+
 /// Defines how the given outline points are transform to stroke
 /// points.
 struct StrokeSettings {
 	float width; /// Width of the stroke (point normal length).
 	bool loop; /// Whether to loop points
 
-	/// Fringe of caps. Anti-aliasing width of the caps, i.e.
-	/// start and end of the line (which might look aliased otherwise).
+	/// Fringe of butt and square caps. Anti-aliasing width of the caps,
+	/// i.e. start and end of the line (which might look aliased otherwise).
 	/// Set to 0.f to disable.  Automatically disabled for loops.
 	float capFringe {1.f};
 	float fringe {1.f};
@@ -28,6 +45,22 @@ struct StrokeSettings {
 	///  0: equally inwards and outwards (making the given points the center)
 	///  1: purely outwards
 	float extrude {0.f};
+
+	/// How segments are joined. Miter joins whose miter length would be
+	/// larger than miterLimit * width are drawn as bevel joins instead.
+	/// Round joins are tessellated with segments that deviate at most
+	/// roundTolerance from the exact arc, i.e. thin strokes get fewer.
+	/// Joins of (nearly) straight segments are always drawn as miter
+	/// when that is within roundTolerance.
+	LineJoin join {LineJoin::miter};
+	float miterLimit {4.f};
+	float roundTolerance {0.25f};
+
+	/// How the start and end of the stroke are drawn, ignored for loops.
+	/// Square caps extend the stroke by half its width. Round caps are
+	/// tessellated like round joins (roundTolerance) and anti-aliased
+	/// with the regular fringe.
+	LineCap cap {LineCap::butt};
 };
 
 /// Vertex of a stroke operation.
@@ -35,6 +68,9 @@ struct StrokeSettings {
 /// Its y value if 1.f for vertices on the left and -1.f for vertices
 /// on the right. Knowing the stroke width one can easily compute
 /// a stroke mask (e.g. in a fragment shader).
+/// The x value goes from 0.f to 1.f across the fringe of butt and square
+/// caps and is 1.f everywhere else. Round caps are a fan around the
+/// center of the stroke with y values of 0.f there and 1.f on the arc.
 struct Vertex {
 	Vec2f position;
 	Vec2f aa;
@@ -46,6 +82,12 @@ struct Vertex {
 using VertexHandlerFn = std::function<void(const Vertex&)>;
 using IndexHandlerFn = std::function<void(unsigned)>;
 
+/// Enables the vertex handler templates below only for types that can
+/// be called with a vertex (and not e.g. for a Span<Vertex>).
+template<typename H, typename T = void>
+using IfVertexHandler = std::enable_if_t<
+	std::is_invocable_v<std::remove_reference_t<H>&, const Vertex&>, T>;
+
 
 /// Generates the vertices to stroke the given points.
 /// The vertices will be ordered triangle-strip like.
@@ -64,6 +106,63 @@ void bakeColoredStroke(Span<const Vec2f> points, Span<const Vec4u8> color,
 void bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
 	Span<const Vec4u8> color, const VertexHandlerFn& handler);
 
+/// Like the VertexHandlerFn versions but call the given handler directly
+/// instead of through a std::function, so the vertex output can be
+/// inlined. Chosen e.g. when passing a lambda. The handler must be
+/// callable with a const Vertex&.
+template<typename H, typename = IfVertexHandler<H>>
+void bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+	H&& handler);
+template<typename H, typename = IfVertexHandler<H>>
+void bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+	Span<const Vec4u8> color, H&& handler);
+
+/// Returns the exact number of vertices bakeStroke generates for the
+/// given points and settings. Has about the cost of baking the stroke
+/// without writing the vertices.
+unsigned strokeVertexCount(Span<const Vec2f> points, const StrokeSettings&);
+
+/// Like bakeStroke but writes the vertices into the given span that
+/// must have at least strokeVertexCount elements, e.g. mapped gpu memory.
+/// Returns the number of written vertices.
+unsigned bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+	Span<Vertex> out);
+unsigned bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+	Span<const Vec4u8> color, Span<Vertex> out);
+
+
+/// Dash pattern of a stroke, see svg stroke-dasharray and
+/// stroke-dashoffset. array holds the alternating lengths of the dashes
+/// and gaps, starting with a dash. It is repeated twice if it has an odd
+/// number of values. offset is the distance into the pattern at which
+/// the stroke starts.
+struct DashPattern {
+	Span<const float> array;
+	float offset {0.f};
+};
+
+/// Like bakeStroke but only strokes the dashes of the given pattern.
+/// Walks the points once and strokes each dash (including its caps) as
+/// soon as its end is found. The dashes are separated by two vertices
+/// that only form degenerate triangles, so the output is still a single
+/// triangle strip. All dashes use the orientation (see extrude) of the
+/// whole line. Like in svg, dashes with zero length only consist of
+/// their caps, so they are omitted for butt caps. Patterns that are
+/// empty, have negative values or a sum of zero stroke the whole line.
+/// The points of the current dash are collected in buffers allocated
+/// from the given memory resource, once per call.
+template<typename H, typename = IfVertexHandler<H>>
+void bakeDashedStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+	const DashPattern& dash, H&& handler,
+	std::pmr::memory_resource* = std::pmr::get_default_resource());
+template<typename H, typename = IfVertexHandler<H>>
+void bakeDashedStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+	const DashPattern& dash, Span<const Vec4u8> color, H&& handler,
+	std::pmr::memory_resource* = std::pmr::get_default_resource());
+
+/// Returns the exact number of vertices bakeDashedStroke generates.
+unsigned dashedStrokeVertexCount(Span<const Vec2f> points,
+	const StrokeSettings&, const DashPattern&);
 
 /// Bakes fill and stroke vertices for an edge antialiased shape.
 /// Will effectively inset the points to fill about fringe and then
@@ -85,13 +184,68 @@ void bakeFillAA(Span<const Vec2f> points, Span<const Vec4u8> color,
 	float fringe, const VertexHandlerFn& fill,
 	const VertexHandlerFn& stroke);
 
+/// Like the VertexHandlerFn versions but with directly called handlers,
+/// see the bakeStroke templates.
+template<typename F, typename S,
+	typename = IfVertexHandler<F, IfVertexHandler<S>>>
+void bakeFillAA(Span<const Vec2f> points, float fringe, F&& fill, S&& stroke);
+template<typename F, typename S,
+	typename = IfVertexHandler<F, IfVertexHandler<S>>>
+void bakeFillAA(Span<const Vec2f> points, Span<const Vec4u8> color,
+	float fringe, F&& fill, S&& stroke);
+
+/// Number of fill and stroke vertices generated by bakeFillAA.
+struct FillAACount {
+	unsigned fill;
+	unsigned stroke;
+};
+
+/// Returns the exact number of vertices bakeFillAA generates for the
+/// given points. Has about the cost of baking without writing the vertices.
+FillAACount fillAAVertexCount(Span<const Vec2f> points);
+
+/// Like bakeFillAA but writes the vertices into the given spans that
+/// must be at least as large as returned by fillAAVertexCount.
+/// Returns the number of written vertices.
+FillAACount bakeFillAA(Span<const Vec2f> points, float fringe,
+	Span<Vertex> fill, Span<Vertex> stroke);
+FillAACount bakeFillAA(Span<const Vec2f> points, Span<const Vec4u8> color,
+	float fringe, Span<Vertex> fill, Span<Vertex> stroke);
+
+/// Allocator-aware like Path (path.hpp).
 struct CombinedFill {
-	std::vector<unsigned> indices;
-	std::vector<Vertex> vertices;
+	using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+	std::pmr::vector<unsigned> indices;
+	std::pmr::vector<Vertex> vertices;
+
+	CombinedFill() = default;
+	explicit CombinedFill(const allocator_type& alloc) :
+		indices(alloc), vertices(alloc) {}
 };
 
+/// The returned vectors allocate from the given memory resource.
 CombinedFill bakeCombinedFillAA(Span<const Vec2f> points,
-	Span<const Vec4u8> color, float fringe);
+	Span<const Vec4u8> color, float fringe,
+	std::pmr::memory_resource* = std::pmr::get_default_resource());
+
+/// Number of vertices and indices generated by bakeCombinedFillAA.
+struct CombinedFillCount {
+	unsigned vertices;
+	unsigned indices;
+};
+
+/// Returns the exact number of vertices and indices bakeCombinedFillAA
+/// generates for the given points.
+CombinedFillCount combinedFillAACount(Span<const Vec2f> points);
+
+/// Like bakeCombinedFillAA but writes into the given spans that must be
+/// at least as large as returned by combinedFillAACount. baseVertex is
+/// added to all indices, e.g. when multiple fills are baked into the
+/// same buffers. Returns the number of written vertices and indices.
+CombinedFillCount bakeCombinedFillAA(Span<const Vec2f> points,
+	Span<const Vec4u8> color, float fringe, Span<Vertex> vertices,
+	Span<unsigned> indices, unsigned baseVertex = 0u);
 
 
 /// Returns the signed area of the polygon with the given points.
@@ -119,3 +273,5 @@ template<typename T> std::vector<T> triangleFanIndices(unsigned count);
 template<typename T> std::vector<T> triangleStripIndices(unsigned count);
 
 } // namespace ktc
+
+#include <katachi/stroke.inl>
@@ -0,0 +1,670 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+// Implementation of the stroke and fill templates of stroke.hpp.
+// Included by stroke.hpp, don't include this directly.
+// The non-template versions in stroke.cpp forward to these as well.
+
+#pragma once
+
+#include <nytl/math.hpp>
+#include <nytl/span.hpp>
+#include <nytl/vecOps.hpp>
+#include <nytl/approxVec.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ktc {
+namespace detail {
+
+/// Returns the left normal of a 2 dimensional vector.
+template<typename T>
+Vec2<T> lnormal(Vec2<T> vec) {
+	return {-vec[1], vec[0]};
+}
+
+/// Returns the right normal of a 2 dimensional vector.
+template<typename T>
+Vec2<T> rnormal(Vec2<T> vec) {
+	return {vec[1], -vec[0]};
+}
+
+/// Whether stroke/fill operations record stats (stats.hpp). Without
+/// KTC_STATS, the counting and recording below is compiled out.
+#ifdef KTC_STATS
+	constexpr auto recordStats = true;
+#else
+	constexpr auto recordStats = false;
+#endif
+
+/// Records the vertices and skipped points of a stroke/fill operation
+/// in the stats of the calling thread. Only defined (in stats.cpp) and
+/// called when recordStats is true.
+void recordStroke(unsigned vertices, unsigned degenerate);
+void recordFill(unsigned vertices, unsigned degenerate);
+
+/// Handler that only counts its calls. Used to compute the exact output
+/// sizes, nothing is recorded in the stats for it.
+struct CountHandler {
+	unsigned count {};
+
+	template<typename T>
+	void operator()(const T&) {
+		++count;
+	}
+};
+
+/// Returns whether the given handler can be called, i.e. false only
+/// for empty std::functions and null function pointers.
+template<typename H>
+bool validHandler(const H& handler) {
+	if constexpr(std::is_constructible_v<bool, const H&>) {
+		return bool(handler);
+	} else {
+		return true;
+	}
+}
+
+/// Checks the preconditions of the stroke functions. The templates can't
+/// use dlg since it is not a public dependency, so this uses assert.
+template<typename H>
+void checkStroke(const StrokeSettings& settings, const H& handler) {
+	assert(settings.width > 0.f);
+	assert(settings.roundTolerance > 0.f);
+	assert(validHandler(handler));
+	(void) settings;
+	(void) handler;
+}
+
+/// Returns the number of segments to approximate an arc with the given
+/// angle and radius, so that they deviate at most tolerance from it.
+inline unsigned roundSteps(float angle, float radius, float tolerance) {
+	if(tolerance >= radius) {
+		return 1u;
+	}
+
+	auto step = 2.f * std::acos(1.f - tolerance / radius);
+	auto steps = std::ceil(angle / step);
+	return unsigned(std::clamp(steps, 1.f, 1024.f));
+}
+
+/// Outputs the vertex pairs (left, right) joining stroke segments.
+/// The left vertices are at p + lwidth * normal, the right ones at
+/// p + rwidth * normal.
+struct StrokeJoin {
+	float lwidth;
+	float rwidth;
+	LineJoin join;
+	float limit2; // squared miter limit
+	float tolerance;
+	float straight2; // see below
+	float lwidth2, lwidthInv2;
+	float rwidth2, rwidthInv2;
+
+	StrokeJoin(const StrokeSettings& settings, float lwidth, float rwidth) :
+			lwidth(lwidth), rwidth(rwidth), join(settings.join),
+			limit2(settings.miterLimit * settings.miterLimit),
+			tolerance(settings.roundTolerance) {
+		// For joins with cos(angle / 2)^2 >= straight2, the miter
+		// deviates at most tolerance from a round join (or a bevel)
+		auto width = std::max(std::abs(lwidth), std::abs(rwidth));
+		auto c = width / (width + tolerance);
+		straight2 = c * c;
+
+		lwidth2 = lwidth * lwidth;
+		rwidth2 = rwidth * rwidth;
+		lwidthInv2 = 1.f / lwidth2;
+		rwidthInv2 = 1.f / rwidth2;
+	}
+
+	/// Joins the segments with the given (not normalized) normals d0, d1
+	/// at point p. If closing is true, only outputs the first pair (which
+	/// continues the stroke of the previous segment), used at the end of
+	/// loops whose first join was already output.
+	/// Returns the number of output vertices.
+	template<typename H>
+	unsigned operator()(H& handler, Vec2f p, Vec2f d0, Vec2f d1,
+			Vec4u8 color, bool closing) const {
+		auto emit = [&](Vec2f left, Vec2f right) {
+			handler(Vertex{p + lwidth * left, {1.f, 1.f}, color});
+			handler(Vertex{p + rwidth * right, {1.f, -1.f}, color});
+		};
+
+		auto l0 = dot(d0, d0);
+		auto l1 = dot(d1, d1);
+		auto n0 = (1.f / std::sqrt(l0)) * d0;
+		auto n1 = (1.f / std::sqrt(l1)) * d1;
+		auto e = 0.5f * (n0 + n1);
+
+		// cos^2 of half the angle between the normals. Only zero if the
+		// stroke turns back exactly, the miter point is then p
+		auto e2 = std::max(dot(e, e), 1e-12f);
+		auto m = (1.f / e2) * e;
+
+		// the outer side is the one the stroke turns away from
+		auto turn = cross(n0, n1);
+		auto leftOuter = lwidth * turn >= 0.f;
+		auto iwidth2 = leftOuter ? rwidth2 : lwidth2;
+		auto iwidthInv2 = leftOuter ? rwidthInv2 : lwidthInv2;
+
+		// At sharp angles, the inner miter point would lie beyond the
+		// segments. Move it towards p so that it doesn't, limit is the
+		// ratio of squared distances to the end of the shorter segment.
+		// Scaling by limit instead of sqrt(limit) moves it a bit further
+		// than needed but avoids a branch or square root.
+		auto limit = e2 * (std::min(l0, l1) + iwidth2) * iwidthInv2;
+		auto inner = std::min(limit, 1.f) * m;
+
+		// common case: a single pair at the miter point
+		auto miter = (e2 >= straight2) |
+			((limit2 * e2 >= 1.f) & (join == LineJoin::miter));
+
+		// Outputs the pairs for the outer normals n0, ..., n1. Only has
+		// a single place that outputs vertices, so everything is inlined
+		auto pairs = 1u;
+		auto n = m;
+		auto cosStep = 1.f;
+		auto sinStep = 0.f;
+		if(!miter) {
+			// bevel or round: rotate the normal from n0 to n1
+			auto steps = 1u;
+			if(join == LineJoin::round) {
+				auto owidth = leftOuter ? lwidth : rwidth;
+				auto angle = std::acos(std::clamp(dot(n0, n1), -1.f, 1.f));
+				steps = roundSteps(angle, std::abs(owidth), tolerance);
+				auto dir = turn != 0.f ? turn : owidth; // only the sign matters
+				auto step = (dir > 0.f ? angle : -angle) / steps;
+				cosStep = std::cos(step);
+				sinStep = std::sin(step);
+			}
+
+			pairs = closing ? 1u : steps + 1;
+			n = n0;
+		}
+
+		for(auto i = 0u; i < pairs; ++i) {
+			auto outer = (i > 0 && i + 1 == pairs) ? n1 : n;
+
+			// select instead of branching, the side is hard to predict
+			auto left = leftOuter ? outer : inner;
+			auto right = leftOuter ? inner : outer;
+			emit(left, right);
+
+			n = {cosStep * n.x - sinStep * n.y, sinStep * n.x + cosStep * n.y};
+		}
+
+		return 2 * pairs;
+	}
+};
+
+/// Outputs the start or end cap of a stroke at p, dir is the normalized
+/// direction of the stroke there. Start caps end with the pair at p the
+/// stroke continues from, end caps start with it (or the pair inside
+/// the cap fringe). lwidth and rwidth as for StrokeJoin.
+/// Returns the number of output vertices.
+template<typename H>
+unsigned strokeCap(H& handler, const StrokeSettings& settings, Vec2f p,
+		Vec2f dir, float lwidth, float rwidth, Vec4u8 color, bool start) {
+	auto normal = rnormal(dir);
+	auto outwards = (start ? -1.f : 1.f) * dir;
+	auto pair = [&](float offset, float aa) {
+		auto o = p + offset * outwards;
+		handler(Vertex{o + lwidth * normal, {aa, 1.f}, color});
+		handler(Vertex{o + rwidth * normal, {aa, -1.f}, color});
+	};
+
+	if(settings.cap == LineCap::round) {
+		// Fan around the center of the stroke, from the right to the
+		// left side. Between it and the pair at p are only degenerate
+		// triangles.
+		constexpr auto pi = float(nytl::constants::pi);
+		auto center = p + (0.5f * (lwidth + rwidth)) * normal;
+		auto side = (0.5f * (lwidth - rwidth)) * normal;
+		auto radius = 0.5f * std::abs(lwidth - rwidth);
+		auto steps = roundSteps(pi, radius, settings.roundTolerance);
+
+		if(!start) {
+			pair(0.f, 1.f);
+		}
+
+		for(auto i = 0u; i <= steps; ++i) {
+			auto angle = i * pi / steps;
+			auto arc = center - std::cos(angle) * side +
+				(radius * std::sin(angle)) * outwards;
+			handler(Vertex{center, {1.f, 0.f}, color});
+			handler(Vertex{arc, {1.f, 1.f}, color});
+		}
+
+		if(start) {
+			pair(0.f, 1.f);
+		}
+
+		return 2 * steps + 4;
+	}
+
+	// butt and square caps only differ in where they end
+	auto extend = settings.cap == LineCap::square ? 0.5f * settings.width : 0.f;
+	auto fringe = 0.5f * settings.capFringe;
+	if(fringe <= 0.f) {
+		pair(extend, 1.f);
+		return 2u;
+	}
+
+	pair(extend + (start ? fringe : -fringe), start ? 0.f : 1.f);
+	pair(extend + (start ? -fringe : fringe), start ? 1.f : 0.f);
+	return 4u;
+}
+
+/// Number of output vertices and skipped points of a stroke.
+struct StrokeCount {
+	unsigned vertices;
+	unsigned degenerate;
+};
+
+/// Returns the widths {owidth, iwidth} of the stroke to the outside and
+/// inside of the given points, with their orientation taken into account.
+inline std::pair<float, float> strokeWidths(Span<const Vec2f> points,
+		const StrokeSettings& settings) {
+	auto iwidth = settings.width * (0.5f + 0.5f * settings.extrude);
+	auto owidth = settings.width * (0.5f - 0.5f * settings.extrude);
+	iwidth += 0.5 * settings.fringe; // half extrude, half inside
+	owidth += 0.5 * settings.fringe; // half extrude, half inside
+
+	// we will in the following assume that the points are ordered
+	// counter-clockwise
+	if(area(points) < 0.0) {
+		std::swap(iwidth, owidth);
+		iwidth *= -1;
+		owidth *= -1;
+	}
+
+	return {owidth, iwidth};
+}
+
+/// Strokes the given (at least 2) points with the widths returned by
+/// strokeWidths. Doesn't record stats.
+template<typename H>
+StrokeCount strokeLine(Span<const Vec2f> points, const StrokeSettings& settings,
+		Span<const Vec4u8> color, float owidth, float iwidth, H& handler) {
+	auto p0 = points.back();
+	auto p1 = points.front();
+	auto p2 = points[1];
+
+	// start cap
+	auto start = 0u;
+	auto end = points.size() + settings.loop;
+	auto caps = !settings.loop &&
+		(settings.cap != LineCap::butt || settings.capFringe > 0.f);
+	auto capVertices = 0u;
+	if(caps) {
+		start = 1u;
+		end = points.size() - 1;
+
+		auto c = color.size() > 0 ? color[0] : Vec4u8{0, 0, 0, 255};
+		capVertices += strokeCap(handler, settings, p1, normalized(p2 - p1),
+			owidth, -iwidth, c, true);
+
+		p0 = p1;
+		p1 = p2;
+		p2 = points[2 % points.size()];
+	}
+
+	auto join = StrokeJoin(settings, owidth, -iwidth);
+	auto degenerate = 0u;
+	auto vertices = 0u;
+	for(auto i = start; i < end; ++i) {
+		auto d0 = rnormal(p1 - p0);
+		auto d1 = rnormal(p2 - p1);
+
+		if(i == 0 && !settings.loop) {
+			d0 = d1;
+		} else if(i == points.size() - 1 && !settings.loop) {
+			d1 = d0;
+		}
+
+		// skip point if same to next or previous one
+		// this assures normalized below will not throw (for nullvector)
+		if(d0 == approx(Vec{0.f, 0.f}) || d1 == approx(Vec{0.f, 0.f})) {
+			if constexpr(recordStats) {
+				++degenerate;
+			}
+
+			p1 = p2;
+			p2 = points[(i + 2) % points.size()];
+			continue;
+		}
+
+		auto c = color.size() > i ? color[i] : Vec4u8{0, 0, 0, 255};
+		auto closing = settings.loop && i == points.size();
+		vertices += join(handler, p1, d0, d1, c, closing);
+
+		p0 = points[(i + 0) % points.size()];
+		p1 = points[(i + 1) % points.size()];
+		p2 = points[(i + 2) % points.size()];
+	}
+
+	// end cap
+	if(caps) {
+		auto i = points.size() - 1;
+		auto c = color.size() > i ? color[i] : Vec4u8{0, 0, 0, 255};
+		capVertices += strokeCap(handler, settings, p1, normalized(p1 - p0),
+			owidth, -iwidth, c, false);
+	}
+
+	return {capVertices + vertices, degenerate};
+}
+
+template<typename H>
+void bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+		Span<const Vec4u8> color, H& handler) {
+	if(points.size() < 2) {
+		return;
+	}
+
+	auto [owidth, iwidth] = strokeWidths(points, settings);
+	auto count = strokeLine(points, settings, color, owidth, iwidth, handler);
+	if constexpr(recordStats && !std::is_same_v<H, CountHandler>) {
+		recordStroke(count.vertices, count.degenerate);
+	}
+}
+
+/// Handler that separates the strokes of multiple dashes in a triangle
+/// strip. Repeats the last vertex of the previous dash and the first one
+/// of the next dash, so that the triangles between them are degenerate.
+template<typename H>
+struct DashHandler {
+	H& handler;
+	Vertex last {};
+	bool first {true}; // next vertex is the first one of a dash
+	bool started {}; // whether a dash was output
+	unsigned vertices {}; // number of separating vertices
+
+	void operator()(const Vertex& vertex) {
+		if(first) {
+			if(started) {
+				handler(last);
+				handler(vertex);
+				vertices += 2;
+			}
+
+			first = false;
+			started = true;
+		}
+
+		handler(vertex);
+		last = vertex;
+	}
+};
+
+template<typename H>
+void bakeDashedStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+		const DashPattern& dash, Span<const Vec4u8> color, H& handler,
+		std::pmr::memory_resource* memory) {
+	if(points.size() < 2) {
+		return;
+	}
+
+	auto period = 0.f;
+	auto valid = !dash.array.empty();
+	for(auto value : dash.array) {
+		valid &= value >= 0.f;
+		period += value;
+	}
+
+	if(!valid || !(period > 0.f)) {
+		bakeStroke(points, settings, color, handler);
+		return;
+	}
+
+	// odd patterns are repeated to get an even number of values
+	auto count = unsigned(dash.array.size());
+	if(count % 2 == 1) {
+		count *= 2;
+		period *= 2;
+	}
+
+	auto entryLength = [&](unsigned i) {
+		return dash.array[i % dash.array.size()];
+	};
+
+	// find the start in the pattern. The loop is bounded since pos
+	// might not get below the entries due to rounding. Stops at the
+	// start of an entry, so that zero-length dashes there are kept
+	auto pos = std::fmod(dash.offset, period);
+	pos = pos < 0.f ? pos + period : pos;
+	auto entry = 0u;
+	for(auto i = 0u; i < count && pos > 0.f && pos >= entryLength(entry);
+			++i) {
+		pos -= entryLength(entry);
+		entry = (entry + 1) % count;
+	}
+
+	auto remaining = double(std::max(entryLength(entry) - pos, 0.f));
+	auto on = entry % 2 == 0;
+
+	// the points (and colors) of the current dash
+	std::pmr::vector<Vec2f> dashPoints(memory);
+	std::pmr::vector<Vec4u8> dashColors(memory);
+	dashPoints.reserve(points.size() + 3);
+	if(!color.empty()) {
+		dashColors.reserve(points.size() + 3);
+	}
+
+	auto add = [&](Vec2f p, unsigned i) {
+		if(!dashPoints.empty() && dashPoints.back() == p) {
+			return;
+		}
+
+		dashPoints.push_back(p);
+		if(!color.empty()) {
+			dashColors.push_back(color.size() > i ?
+				color[i] : Vec4u8{0, 0, 0, 255});
+		}
+	};
+
+	auto [owidth, iwidth] = strokeWidths(points, settings);
+	auto dashSettings = settings;
+	dashSettings.loop = false;
+	auto dashHandler = DashHandler<H>{handler};
+	auto total = StrokeCount{0u, 0u};
+	auto dir = Vec2f {}; // direction of the last non-empty segment
+	auto finish = [&]{
+		if(dashPoints.size() >= 2) {
+			dashHandler.first = true;
+			auto c = strokeLine(dashPoints, dashSettings, dashColors,
+				owidth, iwidth, dashHandler);
+			total.vertices += c.vertices;
+			total.degenerate += c.degenerate;
+		} else if(dashPoints.size() == 1 && settings.cap != LineCap::butt &&
+				dir != Vec2f{}) {
+			// like in svg, zero-length dashes are drawn as their caps,
+			// oriented along the segment they are on
+			dashHandler.first = true;
+			auto c = dashColors.empty() ? Vec4u8{0, 0, 0, 255} : dashColors[0];
+			total.vertices += strokeCap(dashHandler, dashSettings,
+				dashPoints[0], dir, owidth, -iwidth, c, true);
+			total.vertices += strokeCap(dashHandler, dashSettings,
+				dashPoints[0], dir, owidth, -iwidth, c, false);
+		}
+
+		dashPoints.clear();
+		dashColors.clear();
+	};
+
+	if(on) {
+		add(points[0], 0u);
+	}
+
+	// Walk the segments, t is the distance from the segment start.
+	// It is accumulated in double precision so that short dashes on long
+	// segments still advance it. Interpolated points get the color of
+	// the segment start
+	auto segments = points.size() - !settings.loop;
+	for(auto i = 0u; i < segments; ++i) {
+		auto a = points[i];
+		auto j = unsigned((i + 1) % points.size());
+		auto b = points[j];
+		auto len = double(length(b - a));
+		if(len > 0.0) {
+			dir = normalized(b - a);
+		}
+
+		auto t = 0.0;
+		while(len - t > remaining) {
+			// When the pattern is below the precision at this distance,
+			// t would not increase anymore. Keep the current state for
+			// the rest of the segment instead.
+			auto next = t + remaining;
+			if(remaining > 0.0 && !(next > t)) {
+				remaining = len - t;
+				break;
+			}
+
+			t = next;
+			add(a + float(t / len) * (b - a), i);
+			if(on) {
+				finish();
+			}
+
+			entry = (entry + 1) % count;
+			remaining = entryLength(entry);
+			on = !on;
+		}
+
+		remaining -= len - t;
+		if(on) {
+			add(b, j);
+		}
+	}
+
+	if(on) {
+		finish();
+	}
+
+	if constexpr(recordStats && !std::is_same_v<H, CountHandler>) {
+		recordStroke(total.vertices + dashHandler.vertices, total.degenerate);
+	}
+}
+
+template<typename F, typename S>
+void bakeFillAA(Span<const Vec2f> points, Span<const Vec4u8> color,
+		float fringe, F& fill, S& stroke) {
+	if(points.size() < 2) {
+		return;
+	}
+
+	auto loop = points.front() == points.back();
+	if(loop) {
+		points = points.first(points.size() - 1);
+	}
+
+	fringe *= 0.5f;
+	if(area(points) < 0.0) {
+		fringe *= -1;
+	}
+
+	auto p0 = points.back();
+	auto p1 = points.front();
+	auto p2 = points[1];
+
+	auto degenerate = 0u;
+	auto end = points.size() + loop;
+	for(auto i = 0u; i < end; ++i) {
+		auto d0 = rnormal(p1 - p0);
+		auto d1 = rnormal(p2 - p1);
+
+		if(i == 0 && !loop) {
+			d0 = d1;
+		} else if(i == points.size() - 1 && !loop) {
+			d1 = d0;
+		}
+
+		// skip point if same to next or previous one
+		// this assures normalized below will not throw (for nullvector)
+		if(d0 == approx(Vec {0.f, 0.f}) || d1 == approx(Vec {0.f, 0.f})) {
+			if constexpr(recordStats) {
+				++degenerate;
+			}
+
+			p1 = p2;
+			p2 = points[(i + 2) % points.size()];
+			continue;
+		}
+
+		// fill
+		auto extrusion = 0.5f * (normalized(d0) + normalized(d1));
+		extrusion *= 1.f / dot(extrusion, extrusion);
+
+		auto c = color.size() > i ? color[i] : Vec4u8{0, 0, 0, 255};
+		fill(Vertex{p1 - fringe * extrusion, {1.f, 0.f}, c});
+
+		// stroke
+		stroke(Vertex{p1 - fringe * extrusion, {1.f, 0.f}, c});
+		stroke(Vertex{p1 + fringe * extrusion, {1.f, 1.f}, c});
+
+		p0 = points[(i + 0) % points.size()];
+		p1 = points[(i + 1) % points.size()];
+		p2 = points[(i + 2) % points.size()];
+	}
+
+	if constexpr(recordStats && !std::is_same_v<F, CountHandler>) {
+		recordFill(3 * unsigned(end - degenerate), degenerate);
+	}
+}
+
+} // namespace detail
+
+template<typename H, typename>
+void bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+		H&& handler) {
+	detail::checkStroke(settings, handler);
+	detail::bakeStroke(points, settings, {}, handler);
+}
+
+template<typename H, typename>
+void bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+		Span<const Vec4u8> color, H&& handler) {
+	detail::checkStroke(settings, handler);
+	detail::bakeStroke(points, settings, color, handler);
+}
+
+template<typename H, typename>
+void bakeDashedStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+		const DashPattern& dash, H&& handler, std::pmr::memory_resource* memory) {
+	detail::checkStroke(settings, handler);
+	detail::bakeDashedStroke(points, settings, dash, {}, handler, memory);
+}
+
+template<typename H, typename>
+void bakeDashedStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+		const DashPattern& dash, Span<const Vec4u8> color, H&& handler,
+		std::pmr::memory_resource* memory) {
+	detail::checkStroke(settings, handler);
+	detail::bakeDashedStroke(points, settings, dash, color, handler, memory);
+}
+
+template<typename F, typename S, typename>
+void bakeFillAA(Span<const Vec2f> points, float fringe, F&& fill,
+		S&& stroke) {
+	assert(fringe > 0.f);
+	assert(detail::validHandler(fill));
+	assert(detail::validHandler(stroke));
+	detail::bakeFillAA(points, {}, fringe, fill, stroke);
+}
+
+template<typename F, typename S, typename>
+void bakeFillAA(Span<const Vec2f> points, Span<const Vec4u8> color,
+		float fringe, F&& fill, S&& stroke) {
+	assert(fringe > 0.f);
+	assert(detail::validHandler(fill));
+	assert(detail::validHandler(stroke));
+	detail::bakeFillAA(points, color, fringe, fill, stroke);
+}
+
+} // namespace ktc
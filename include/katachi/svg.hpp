@@ -6,10 +6,12 @@
 
 #include <katachi/fwd.hpp>
 #include <katachi/path.hpp>
-#include <nytl/stringParam.hpp>
 #include <nytl/vec.hpp>
 #include <optional>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace ktc {
 
@@ -39,15 +41,142 @@ std::string description(const SvgError&);
 /// the other overload throws.
 /// Only the first command is allowed to be a move command and will override
 /// the passed start parameter.
-Subpath parseSvgSubpath(StringParam svgSubpath, Vec2f start = {});
-Subpath parseSvgSubpath(StringParam svgSubpath, std::optional<SvgError>&,
+/// The string does not have to be null-terminated, so path data can be
+/// parsed in place, e.g. directly from a mapped file.
+Subpath parseSvgSubpath(std::string_view svgSubpath, Vec2f start = {});
+Subpath parseSvgSubpath(std::string_view svgSubpath, std::optional<SvgError>&,
 	nytl::Vec2f start = {});
 
 /// Parses the given svg subpath string. The overload with optional error
 /// reference simply returns the error and an empty subpath on error,
 /// the other overload throws.
-Path parseSvgPath(StringParam svgPath, Vec2f start = {});
-Path parseSvgPath(StringParam svgPath, std::optional<SvgError>&,
+/// The string does not have to be null-terminated.
+Path parseSvgPath(std::string_view svgPath, Vec2f start = {});
+Path parseSvgPath(std::string_view svgPath, std::optional<SvgError>&,
 	Vec2f start = {});
 
+/// Receives the segments of a parsed svg path. All points are absolute,
+/// the control points of smooth curves are already resolved.
+/// Every subpath starts with a moveTo.
+class SvgPathSink {
+public:
+	virtual ~SvgPathSink() = default;
+
+	virtual void moveTo(Vec2f to) = 0;
+	virtual void lineTo(Vec2f to) = 0;
+	virtual void quadTo(Vec2f control, Vec2f to) = 0;
+	virtual void cubicTo(Vec2f control1, Vec2f control2, Vec2f to) = 0;
+	virtual void arcTo(const ArcParams&, Vec2f to) = 0;
+	virtual void close() = 0;
+};
+
+/// SvgPathSink that forwards to any object with the same member
+/// functions, so that sinks don't have to derive from SvgPathSink.
+template<typename Sink>
+class SvgPathSinkAdapter : public SvgPathSink {
+public:
+	SvgPathSinkAdapter(Sink& sink) : sink_(sink) {}
+
+	void moveTo(Vec2f to) override { sink_.moveTo(to); }
+	void lineTo(Vec2f to) override { sink_.lineTo(to); }
+	void quadTo(Vec2f control, Vec2f to) override {
+		sink_.quadTo(control, to);
+	}
+	void cubicTo(Vec2f control1, Vec2f control2, Vec2f to) override {
+		sink_.cubicTo(control1, control2, to);
+	}
+	void arcTo(const ArcParams& arc, Vec2f to) override {
+		sink_.arcTo(arc, to);
+	}
+	void close() override { sink_.close(); }
+
+protected:
+	Sink& sink_;
+};
+
+/// Parses the given svg path and passes its segments directly to the
+/// given sink instead of building a Path. Segments before an error
+/// have already been passed to the sink. Returns the error, if any.
+std::optional<SvgError> visitSvgPath(std::string_view svgPath,
+	SvgPathSink& sink, Vec2f start = {});
+
+/// Overload for any sink type with the member functions of SvgPathSink.
+template<typename Sink>
+std::optional<SvgError> visitSvgPath(std::string_view svgPath, Sink& sink,
+		Vec2f start = {}) {
+	if constexpr(std::is_base_of_v<SvgPathSink, Sink>) {
+		return visitSvgPath(svgPath, static_cast<SvgPathSink&>(sink), start);
+	} else {
+		SvgPathSinkAdapter<Sink> adapter(sink);
+		return visitSvgPath(svgPath, static_cast<SvgPathSink&>(adapter), start);
+	}
+}
+
+/// Parses and flattens the given svg path in a single pass, without
+/// building a Path. The points are written to out (overwritten, its
+/// capacity is reused), one entry per subpath. The results are the same
+/// as for flattening the Path returned by parseSvgPath, except that
+/// an empty string results in no subpaths at all.
+/// Returns the error, if any, out is empty then. The overload without
+/// FlattenedPath parameter throws on error.
+std::optional<SvgError> flattenSvgPath(std::string_view svgPath,
+	FlattenedPath& out, const FlattenSettings& = {}, const Transform& = {});
+FlattenedPath flattenSvgPath(std::string_view svgPath,
+	const FlattenSettings& = {}, const Transform& = {});
+
+namespace detail {
+
+/// State of the svg path parser that is kept between chunks.
+struct SvgParserState {
+	Vec2f start {}; // start of the current subpath
+	Vec2f current {}; // current point
+	Vec2f lastControlQ {}; // for resolving smooth curves
+	Vec2f lastControlC {};
+	char command {}; // last command, implicitly repeated
+	bool started {}; // whether a subpath was started
+	bool closed {}; // whether the current subpath was closed
+	unsigned offset {}; // position of the current chunk in the input
+};
+
+} // namespace detail
+
+/// Parses an svg path that is given in chunks, e.g. while it is read
+/// from a file or received over the network. Segments are passed to the
+/// sink as soon as they are complete, only the incomplete tail of a
+/// chunk is buffered. The results are the same as for visitSvgPath
+/// with the whole string.
+class SvgPathStream {
+public:
+	SvgPathStream(SvgPathSink& sink, Vec2f start = {});
+
+	/// Parses the given chunk. Returns false if an error occurred,
+	/// all further input is ignored then.
+	bool feed(std::string_view chunk);
+
+	/// Signals the end of the input and parses the buffered rest.
+	/// Returns false if an error occurred.
+	bool finish();
+
+	/// Returns the error that occurred, if any. Its position
+	/// refers to the whole input.
+	const std::optional<SvgError>& error() const { return error_; }
+
+protected:
+	std::size_t parse(std::string_view input, bool final);
+
+protected:
+	SvgPathSink* sink_;
+	detail::SvgParserState state_;
+	std::string pending_;
+	std::optional<SvgError> error_;
+	bool finished_ {};
+};
+
+/// Scans a number in svg syntax from [begin, end), without depending
+/// on the current locale. Stops at the first char that can't continue
+/// the number, so that compact forms like "1.5.5" or "-1-2" can be
+/// read as two numbers. Returns the end of the scanned number, or
+/// begin if there is no valid number at begin.
+const char* scanSvgNumber(const char* begin, const char* end, float& out);
+
 } // namespace ktc
@@ -0,0 +1,53 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#pragma once
+
+#include <katachi/fwd.hpp>
+#include <katachi/path.hpp>
+#include <katachi/svg.hpp>
+#include <katachi/parallel.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ktc {
+
+enum class SvgElementType {
+	path,
+	rect,
+	circle,
+	ellipse,
+	line,
+	polyline,
+	polygon,
+};
+
+/// Shape element of an svg document, converted to a Path.
+struct SvgElement {
+	SvgElementType type;
+	std::string id; /// The id attribute, empty if there is none
+	Path path;
+	std::optional<SvgError> error; /// Error while parsing the path data
+};
+
+/// Extracts all shape elements (path, rect, circle, ellipse, line,
+/// polyline, polygon) from the given svg document, in document order.
+/// This is not a full xml or svg implementation: transform and
+/// style attributes, units, use elements and entities are ignored.
+/// Elements with invalid geometry (e.g. negative size) result in an empty
+/// path, elements with invalid path data contain the error.
+/// The document is first scanned for elements and their attributes, then
+/// the paths are built using the given parallelFor executor, if any.
+std::vector<SvgElement> loadSvgDocument(std::string_view document,
+	const ParallelForFn& parallelFor = {});
+
+/// Like loadSvgDocument but maps the given file into memory, the
+/// file is parsed in place. Throws std::runtime_error if the file
+/// can't be read.
+std::vector<SvgElement> loadSvgFile(const char* filename,
+	const ParallelForFn& parallelFor = {});
+
+} // namespace ktc
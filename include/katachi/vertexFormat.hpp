@@ -0,0 +1,201 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+// Vertex handlers for the bakeStroke and bakeFillAA templates that write
+// the vertices in other layouts than Vertex: separate streams per
+// attribute (structure-of-arrays) and packed, quantized formats.
+
+#pragma once
+
+#include <katachi/fwd.hpp>
+#include <katachi/stroke.hpp>
+#include <nytl/span.hpp>
+#include <nytl/vec.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace ktc {
+
+/// Converts the given float to the bits of an IEEE 754 half float,
+/// rounding to nearest even. Values too large for half floats
+/// become infinity.
+inline std::uint16_t toHalf(float value) {
+	constexpr auto f16max = std::uint32_t(127 + 16) << 23;
+	constexpr auto infinity = std::uint32_t(255) << 23;
+	constexpr auto denormMagic = std::uint32_t((127 - 15) + (23 - 10) + 1) << 23;
+
+	std::uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	auto sign = std::uint16_t((bits >> 16) & 0x8000u);
+	bits &= 0x7FFFFFFFu;
+
+	std::uint32_t ret;
+	if(bits >= f16max) {
+		ret = bits > infinity ? 0x7E00u : 0x7C00u; // nan, infinity
+	} else if(bits < (std::uint32_t(113) << 23)) {
+		// subnormal or zero: align the mantissa bits at the bottom of
+		// a float by adding a magic number, the float addition rounds
+		float f, magic;
+		std::memcpy(&f, &bits, sizeof(f));
+		std::memcpy(&magic, &denormMagic, sizeof(magic));
+		f += magic;
+		std::memcpy(&bits, &f, sizeof(bits));
+		ret = bits - denormMagic;
+	} else {
+		auto odd = (bits >> 13) & 1u;
+		bits += (std::uint32_t(15 - 127) << 23) + 0xFFFu + odd;
+		ret = bits >> 13;
+	}
+
+	return std::uint16_t(ret | sign);
+}
+
+/// Converts the given bits of an IEEE 754 half float to a float.
+inline float fromHalf(std::uint16_t half) {
+	constexpr auto shiftedExp = std::uint32_t(0x7C00u) << 13;
+	constexpr auto magic = std::uint32_t(113) << 23;
+
+	auto bits = std::uint32_t(half & 0x7FFFu) << 13;
+	auto exp = bits & shiftedExp;
+	bits += std::uint32_t(127 - 15) << 23;
+
+	float ret;
+	if(exp == shiftedExp) { // infinity, nan
+		bits += std::uint32_t(128 - 16) << 23;
+		std::memcpy(&ret, &bits, sizeof(ret));
+	} else if(exp == 0u) { // subnormal
+		bits += 1u << 23;
+		float fmagic;
+		std::memcpy(&ret, &bits, sizeof(ret));
+		std::memcpy(&fmagic, &magic, sizeof(fmagic));
+		ret -= fmagic;
+	} else {
+		std::memcpy(&ret, &bits, sizeof(ret));
+	}
+
+	return (half & 0x8000u) ? -ret : ret;
+}
+
+// Encodings of the position and aa attributes.
+// Each one has the Type it encodes into and a call operator
+// performing the conversion.
+
+/// Unchanged 32-bit floats.
+struct F32Position {
+	using Type = Vec2f;
+	Type operator()(Vec2f p) const { return p; }
+};
+
+/// 16-bit half floats, toHalf. Can be read e.g. as R16G16_SFLOAT.
+/// Only has 11 bits of precision, i.e. positions up to 2048 are exact
+/// to 1, positions up to 32 to 1/64.
+struct F16Position {
+	using Type = Vec2<std::uint16_t>;
+	Type operator()(Vec2f p) const { return {toHalf(p.x), toHalf(p.y)}; }
+};
+
+/// 16-bit signed fixed-point, round((p - origin) * scale), clamped to
+/// the range of int16. Can be read as R16G16_SINT or R16G16_SSCALED and
+/// converted back in the shader. With scale 8 it covers [-4096, 4096)
+/// around the origin with a precision of 1/8.
+struct FixedPosition {
+	using Type = Vec2<std::int16_t>;
+
+	Vec2f origin {0.f, 0.f};
+	float scale {1.f};
+
+	static std::int16_t convert(float v) {
+		v = std::clamp(v, -32768.f, 32767.f);
+		return std::int16_t(v + (v < 0.f ? -0.5f : 0.5f));
+	}
+
+	Type operator()(Vec2f p) const {
+		return {convert((p.x - origin.x) * scale),
+			convert((p.y - origin.y) * scale)};
+	}
+};
+
+/// Unchanged 32-bit floats.
+struct F32AA {
+	using Type = Vec2f;
+	Type operator()(Vec2f aa) const { return aa; }
+};
+
+/// 8-bit signed normalized, the aa values are in [-1, 1] and are
+/// exactly representable. Can be read as R8G8_SNORM.
+struct Snorm8AA {
+	using Type = Vec2<std::int8_t>;
+
+	static std::int8_t convert(float v) {
+		v = 127.f * std::clamp(v, -1.f, 1.f);
+		return std::int8_t(v + (v < 0.f ? -0.5f : 0.5f));
+	}
+
+	Type operator()(Vec2f aa) const { return {convert(aa.x), convert(aa.y)}; }
+};
+
+/// Vertex packed with the given encodings. Without Color the color
+/// is omitted, e.g. when it's uniform for a draw call.
+template<typename P, typename A, bool Color = true>
+struct PackedVertex {
+	typename P::Type position;
+	typename A::Type aa;
+	Vec4u8 color;
+};
+
+template<typename P, typename A>
+struct PackedVertex<P, A, false> {
+	typename P::Type position;
+	typename A::Type aa;
+};
+
+/// Handler that writes the vertices as PackedVertex into the given span,
+/// which must be large enough. count is the number of written vertices.
+/// Can be passed to the bakeStroke and bakeFillAA templates.
+template<typename P, typename A, bool Color = true>
+struct PackedWriter {
+	Span<PackedVertex<P, A, Color>> vertices;
+	P position {};
+	A aa {};
+	unsigned count {};
+
+	void operator()(const Vertex& vertex) {
+		auto& out = vertices[count++];
+		out.position = position(vertex.position);
+		out.aa = aa(vertex.aa);
+		if constexpr(Color) {
+			out.color = vertex.color;
+		}
+	}
+};
+
+/// Handler that writes the attributes of the vertices into separate
+/// streams, which must be large enough. Empty spans are skipped, e.g.
+/// the colors when they are uniform. count is the number of written
+/// vertices.
+template<typename P = F32Position, typename A = F32AA>
+struct SoAWriter {
+	Span<typename P::Type> positions;
+	Span<typename A::Type> aas;
+	Span<Vec4u8> colors;
+	P position {};
+	A aa {};
+	unsigned count {};
+
+	void operator()(const Vertex& vertex) {
+		if(!positions.empty()) {
+			positions[count] = position(vertex.position);
+		}
+		if(!aas.empty()) {
+			aas[count] = aa(vertex.aa);
+		}
+		if(!colors.empty()) {
+			colors[count] = vertex.color;
+		}
+		++count;
+	}
+};
+
+} // namespace ktc
@@ -0,0 +1,77 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <katachi/arena.hpp>
+#include <dlg/dlg.hpp>
+#include <algorithm>
+#include <cstdint>
+
+namespace ktc {
+
+constexpr auto blockAlignment = alignof(std::max_align_t);
+
+FrameArena::FrameArena(std::size_t blockSize,
+		std::pmr::memory_resource* upstream) :
+			upstream_(upstream), blockSize_(blockSize) {
+	dlg_assert(upstream_);
+	dlg_assert(blockSize_ > 0);
+}
+
+FrameArena::~FrameArena() {
+	release();
+}
+
+void FrameArena::reset() {
+	block_ = 0u;
+	offset_ = 0u;
+	used_ = 0u;
+}
+
+void FrameArena::release() {
+	for(auto& block : blocks_) {
+		upstream_->deallocate(block.data, block.size, blockAlignment);
+	}
+
+	blocks_.clear();
+	capacity_ = 0u;
+	reset();
+}
+
+void* FrameArena::do_allocate(std::size_t bytes, std::size_t alignment) {
+	dlg_assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	// try the current and all following (already allocated) blocks
+	for(; block_ < blocks_.size(); ++block_, offset_ = 0u) {
+		auto& block = blocks_[block_];
+		auto addr = reinterpret_cast<std::uintptr_t>(block.data) + offset_;
+		auto padding = (alignment - addr % alignment) % alignment;
+		if(offset_ + padding + bytes <= block.size) {
+			offset_ += padding + bytes;
+			used_ += padding + bytes;
+			return block.data + (offset_ - bytes);
+		}
+	}
+
+	// all blocks are exhausted, allocate a new one. It is kept
+	// and reused after a reset
+	auto size = std::max(blockSize_, bytes + alignment);
+	auto data = static_cast<std::byte*>(
+		upstream_->allocate(size, blockAlignment));
+	block_ = blocks_.size();
+	blocks_.push_back({data, size});
+	capacity_ += size;
+
+	auto addr = reinterpret_cast<std::uintptr_t>(data);
+	auto padding = (alignment - addr % alignment) % alignment;
+	offset_ = padding + bytes;
+	used_ += padding + bytes;
+	return data + padding;
+}
+
+bool FrameArena::do_is_equal(const std::pmr::memory_resource& other)
+		const noexcept {
+	return this == &other;
+}
+
+} // namespace ktc
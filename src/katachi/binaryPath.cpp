@@ -0,0 +1,315 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include "flattener.hpp"
+#include <katachi/binaryPath.hpp>
+#include <dlg/dlg.hpp>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace ktc {
+namespace {
+
+static_assert(sizeof(Vec2f) == 2 * sizeof(float));
+static_assert(sizeof(Verb) == 1);
+
+// Sizes of the sections, see the format description in binaryPath.hpp.
+struct Layout {
+	std::size_t pathSubpaths;
+	std::size_t subpaths;
+	std::size_t points;
+	std::size_t arcRotations;
+	std::size_t nameOffsets;
+	std::size_t verbs;
+	std::size_t names;
+	std::size_t end;
+};
+
+Layout layout(const BinaryPathHeader& h) {
+	// 64-bit arithmetic, all counts are 32-bit
+	Layout ret;
+	ret.pathSubpaths = sizeof(BinaryPathHeader);
+	ret.subpaths = ret.pathSubpaths + 4 * (std::size_t(h.pathCount) + 1);
+	ret.points = ret.subpaths + sizeof(BinarySubpathRange) * h.subpathCount;
+	ret.arcRotations = ret.points + sizeof(Vec2f) * h.pointCount;
+	ret.nameOffsets = ret.arcRotations + sizeof(float) * h.arcCount;
+	ret.verbs = ret.nameOffsets + 4 * (std::size_t(h.pathCount) + 1);
+	ret.names = ret.verbs + h.verbCount;
+	ret.end = ret.names + h.nameSize;
+	return ret;
+}
+
+template<typename T, typename U>
+const T* as(const U* ptr) {
+	return static_cast<const T*>(static_cast<const void*>(ptr));
+}
+
+void invalid(const char* what) {
+	throw std::runtime_error(std::string("Invalid binary path data: ") + what);
+}
+
+} // anon namespace
+
+// BinaryPathWriter
+unsigned BinaryPathWriter::addName(std::string_view name) {
+	if(nameOffsets_.empty()) {
+		nameOffsets_.push_back(0u);
+	}
+
+	names_.append(name);
+	nameOffsets_.push_back(std::uint32_t(names_.size()));
+	pathSubpaths_.push_back(paths_.size());
+	return unsigned(pathSubpaths_.size() - 1);
+}
+
+unsigned BinaryPathWriter::add(const Path& path, std::string_view name) {
+	auto id = addName(name);
+	for(auto& sub : path.subpaths) {
+		append(paths_, sub);
+	}
+
+	return id;
+}
+
+unsigned BinaryPathWriter::add(const CompactPath& path, std::string_view name) {
+	auto id = addName(name);
+	auto verbBase = unsigned(paths_.verbs.size());
+	auto pointBase = unsigned(paths_.points.size());
+	auto arcBase = unsigned(paths_.arcRotations.size());
+	for(auto range : path.subpaths) {
+		range.verb += verbBase;
+		range.point += pointBase;
+		range.arcRotation += arcBase;
+		paths_.subpaths.push_back(range);
+	}
+
+	paths_.verbs.insert(paths_.verbs.end(), path.verbs.begin(), path.verbs.end());
+	paths_.points.insert(paths_.points.end(), path.points.begin(),
+		path.points.end());
+	paths_.arcRotations.insert(paths_.arcRotations.end(),
+		path.arcRotations.begin(), path.arcRotations.end());
+	return id;
+}
+
+std::vector<std::byte> BinaryPathWriter::serialize() const {
+	BinaryPathHeader header {};
+	header.magic = BinaryPathHeader::magicValue;
+	header.version = BinaryPathHeader::currentVersion;
+	header.byteOrder = BinaryPathHeader::byteOrderValue;
+	header.pathCount = size();
+	header.subpathCount = paths_.size();
+	header.verbCount = std::uint32_t(paths_.verbs.size());
+	header.pointCount = std::uint32_t(paths_.points.size());
+	header.arcCount = std::uint32_t(paths_.arcRotations.size());
+	header.nameSize = std::uint32_t(names_.size());
+
+	auto l = layout(header);
+	std::vector<std::byte> ret(l.end);
+	auto write = [&](std::size_t offset, const void* data, std::size_t size) {
+		dlg_assert(offset + size <= ret.size());
+		if(size) {
+			std::memcpy(ret.data() + offset, data, size);
+		}
+	};
+
+	write(0u, &header, sizeof(header));
+
+	auto pathSubpaths = pathSubpaths_;
+	pathSubpaths.push_back(paths_.size());
+	write(l.pathSubpaths, pathSubpaths.data(), 4 * pathSubpaths.size());
+
+	for(auto i = 0u; i < paths_.size(); ++i) {
+		auto& range = paths_.subpaths[i];
+		auto out = BinarySubpathRange {range.verb, range.point,
+			range.arcRotation, range.closed};
+		write(l.subpaths + i * sizeof(out), &out, sizeof(out));
+	}
+
+	write(l.points, paths_.points.data(), sizeof(Vec2f) * header.pointCount);
+	write(l.arcRotations, paths_.arcRotations.data(),
+		sizeof(float) * header.arcCount);
+
+	auto nameOffsets = nameOffsets_.empty() ?
+		std::vector<std::uint32_t>{0u} : nameOffsets_;
+	write(l.nameOffsets, nameOffsets.data(), 4 * nameOffsets.size());
+	write(l.verbs, paths_.verbs.data(), header.verbCount);
+	write(l.names, names_.data(), names_.size());
+	return ret;
+}
+
+void BinaryPathWriter::write(const char* filename) const {
+	auto data = serialize();
+	auto file = std::fopen(filename, "wb");
+	if(!file) {
+		throw std::runtime_error(std::string("Can't open file ") + filename);
+	}
+
+	auto written = std::fwrite(data.data(), 1, data.size(), file);
+	auto closed = std::fclose(file);
+	if(written != data.size() || closed != 0) {
+		throw std::runtime_error(std::string("Can't write file ") + filename);
+	}
+}
+
+// BinaryPathFile
+BinaryPathFile::BinaryPathFile(const char* filename) : file_(filename) {
+	init(as<std::byte>(file_.data()), file_.size());
+}
+
+BinaryPathFile::BinaryPathFile(Span<const std::byte> data) {
+	init(data.data(), data.size());
+}
+
+void BinaryPathFile::init(const std::byte* data, std::size_t size) {
+	if(reinterpret_cast<std::uintptr_t>(data) % 4 != 0) {
+		invalid("data not aligned");
+	}
+
+	if(size < sizeof(BinaryPathHeader)) {
+		invalid("too small");
+	}
+
+	header_ = as<BinaryPathHeader>(data);
+	auto& h = *header_;
+	if(h.magic != BinaryPathHeader::magicValue) {
+		invalid("wrong magic value");
+	} else if(h.byteOrder != BinaryPathHeader::byteOrderValue) {
+		invalid("wrong byte order");
+	} else if(h.version != BinaryPathHeader::currentVersion) {
+		invalid("unsupported version");
+	}
+
+	auto l = layout(h);
+	if(l.end > size) {
+		invalid("too small");
+	}
+
+	pathSubpaths_ = as<std::uint32_t>(data + l.pathSubpaths);
+	subpaths_ = as<BinarySubpathRange>(data + l.subpaths);
+	points_ = as<Vec2f>(data + l.points);
+	arcRotations_ = as<float>(data + l.arcRotations);
+	nameOffsets_ = as<std::uint32_t>(data + l.nameOffsets);
+	verbs_ = as<Verb>(data + l.verbs);
+	names_ = as<char>(data + l.names);
+
+	// validate the indices once so that no further checks are
+	// needed when using the paths
+	for(auto i = 0u; i < h.pathCount; ++i) {
+		if(pathSubpaths_[i] > pathSubpaths_[i + 1] ||
+				nameOffsets_[i] > nameOffsets_[i + 1]) {
+			invalid("invalid path index");
+		}
+	}
+
+	if(pathSubpaths_[0] != 0u || pathSubpaths_[h.pathCount] != h.subpathCount ||
+			nameOffsets_[0] != 0u || nameOffsets_[h.pathCount] != h.nameSize) {
+		invalid("invalid path index");
+	}
+
+	if(h.subpathCount == 0u && (h.verbCount || h.pointCount || h.arcCount)) {
+		invalid("unused data");
+	}
+
+	for(auto i = 0u; i < h.subpathCount; ++i) {
+		auto& range = subpaths_[i];
+		auto last = (i + 1 == h.subpathCount);
+		auto verbEnd = last ? h.verbCount : subpaths_[i + 1].verb;
+		auto pointEnd = last ? h.pointCount : subpaths_[i + 1].point;
+		auto arcEnd = last ? h.arcCount : subpaths_[i + 1].arcRotation;
+
+		// The ranges must start at zero and be monotonic. Checking the
+		// ends against the counts before reading the verbs keeps all
+		// reads in bounds, even if the following ranges are corrupt.
+		auto first = (i == 0u);
+		if((first && (range.verb || range.point || range.arcRotation)) ||
+				verbEnd > h.verbCount || pointEnd > h.pointCount ||
+				arcEnd > h.arcCount || range.verb > verbEnd ||
+				range.point >= pointEnd || range.arcRotation > arcEnd ||
+				range.closed > 1u) {
+			invalid("invalid subpath range");
+		}
+
+		// the start point and the points and arcs of all verbs
+		std::size_t points = 1u;
+		std::size_t arcs = 0u;
+		for(auto v = range.verb; v < verbEnd; ++v) {
+			auto verb = verbs_[v];
+			if(std::uint8_t(verb) > std::uint8_t(Verb::arcLargeClockwise)) {
+				invalid("invalid verb");
+			}
+
+			points += pointCount(verb);
+			arcs += isArc(verb);
+		}
+
+		if(points != pointEnd - range.point ||
+				arcs != arcEnd - range.arcRotation) {
+			invalid("subpath data does not match its verbs");
+		}
+	}
+}
+
+std::string_view BinaryPathFile::name(unsigned path) const {
+	dlg_assert(path < size());
+	auto begin = nameOffsets_[path];
+	return {names_ + begin, nameOffsets_[path + 1] - begin};
+}
+
+std::optional<unsigned> BinaryPathFile::find(std::string_view name) const {
+	for(auto i = 0u; i < size(); ++i) {
+		if(this->name(i) == name) {
+			return i;
+		}
+	}
+
+	return std::nullopt;
+}
+
+unsigned BinaryPathFile::subpathCount(unsigned path) const {
+	dlg_assert(path < size());
+	return pathSubpaths_[path + 1] - pathSubpaths_[path];
+}
+
+CompactSubpath BinaryPathFile::subpath(unsigned path, unsigned i) const {
+	dlg_assert(i < subpathCount(path));
+	auto& h = *header_;
+	auto id = pathSubpaths_[path] + i;
+	auto& range = subpaths_[id];
+	auto last = (id + 1 == h.subpathCount);
+	auto verbEnd = last ? h.verbCount : subpaths_[id + 1].verb;
+	auto pointEnd = last ? h.pointCount : subpaths_[id + 1].point;
+	auto arcEnd = last ? h.arcCount : subpaths_[id + 1].arcRotation;
+
+	CompactSubpath ret;
+	ret.verbs = {verbs_ + range.verb, verbEnd - range.verb};
+	ret.points = {points_ + range.point, pointEnd - range.point};
+	ret.arcRotations = {arcRotations_ + range.arcRotation,
+		arcEnd - range.arcRotation};
+	ret.closed = range.closed;
+	return ret;
+}
+
+Path BinaryPathFile::path(unsigned path) const {
+	Path ret;
+	ret.subpaths.reserve(subpathCount(path));
+	for(auto i = 0u; i < subpathCount(path); ++i) {
+		ret.subpaths.push_back(expand(subpath(path, i)));
+	}
+
+	return ret;
+}
+
+void flatten(const BinaryPathFile& file, unsigned path, FlattenedPath& out,
+		const FlattenSettings& fs, const Transform& transform,
+		const ParallelForFn& parallelFor) {
+	detail::flattenSubpaths(file.subpathCount(path), out, parallelFor,
+		[&](unsigned i) {
+			return flattenedPointCount(file.subpath(path, i), fs, transform);
+		}, [&](unsigned i, Span<Vec2f> points) {
+			flatten(file.subpath(path, i), points, fs, transform);
+		});
+}
+
+} // namespace ktc
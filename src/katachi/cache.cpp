@@ -0,0 +1,220 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <katachi/cache.hpp>
+#include <dlg/dlg.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ktc {
+namespace {
+
+void combine(std::uint64_t& hash, std::uint64_t value) {
+	hash ^= value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+}
+
+void combine(std::uint64_t& hash, float value) {
+	std::uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	combine(hash, std::uint64_t(bits));
+}
+
+void combine(std::uint64_t& hash, Vec2f value) {
+	combine(hash, value.x);
+	combine(hash, value.y);
+}
+
+// Comparisons matching the hashes, i.e. floats are compared bitwise.
+bool same(float a, float b) {
+	return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+bool same(Vec2f a, Vec2f b) {
+	return same(a.x, b.x) && same(a.y, b.y);
+}
+
+bool same(const Command& a, const Command& b) {
+	if(a.params.index() != b.params.index() || !same(a.to, b.to)) {
+		return false;
+	}
+
+	return std::visit([&](auto&& pa) {
+		using T = std::decay_t<decltype(pa)>;
+		auto& pb = std::get<T>(b.params);
+		if constexpr(std::is_same_v<T, QBezierParams>) {
+			return same(pa.control, pb.control);
+		} else if constexpr(std::is_same_v<T, CBezierParams>) {
+			return same(pa.control1, pb.control1) &&
+				same(pa.control2, pb.control2);
+		} else if constexpr(std::is_same_v<T, SCBezierParams>) {
+			return same(pa.control2, pb.control2);
+		} else if constexpr(std::is_same_v<T, ArcParams>) {
+			return same(pa.radius, pb.radius) &&
+				same(pa.rotation, pb.rotation) &&
+				pa.largeArc == pb.largeArc && pa.clockwise == pb.clockwise;
+		} else {
+			return true;
+		}
+	}, a.params);
+}
+
+bool same(const Subpath& a, const Subpath& b) {
+	return same(a.start, b.start) && a.closed == b.closed &&
+		std::equal(a.commands.begin(), a.commands.end(),
+			b.commands.begin(), b.commands.end(),
+			[](auto& ca, auto& cb) { return same(ca, cb); });
+}
+
+// When adding members to FlattenSettings, they must be added to its
+// contentHash and comparison as well.
+static_assert(sizeof(FlattenSettings) == 3 * sizeof(float) +
+	2 * sizeof(unsigned), "FlattenSettings changed, update cache.cpp");
+
+bool same(const FlattenSettings& a, const FlattenSettings& b) {
+	return same(a.arcTolerance, b.arcTolerance) &&
+		a.minArcSteps == b.minArcSteps &&
+		a.maxArcSteps == b.maxArcSteps &&
+		same(a.qBezTolerance, b.qBezTolerance) &&
+		same(a.cBezTolerance, b.cBezTolerance);
+}
+
+} // anon namespace
+
+std::uint64_t contentHash(const Subpath& sub) {
+	std::uint64_t hash = sub.commands.size();
+	combine(hash, sub.start);
+	combine(hash, std::uint64_t(sub.closed));
+
+	auto paramHasher = [&](auto&& p) {
+		using T = std::decay_t<decltype(p)>;
+		if constexpr(std::is_same_v<T, QBezierParams>) {
+			combine(hash, p.control);
+		} else if constexpr(std::is_same_v<T, CBezierParams>) {
+			combine(hash, p.control1);
+			combine(hash, p.control2);
+		} else if constexpr(std::is_same_v<T, SCBezierParams>) {
+			combine(hash, p.control2);
+		} else if constexpr(std::is_same_v<T, ArcParams>) {
+			combine(hash, p.radius);
+			combine(hash, p.rotation);
+			combine(hash, std::uint64_t(p.largeArc | (p.clockwise << 1)));
+		}
+	};
+
+	for(auto& cmd : sub.commands) {
+		combine(hash, std::uint64_t(cmd.params.index()));
+		combine(hash, cmd.to);
+		std::visit(paramHasher, cmd.params);
+	}
+
+	return hash;
+}
+
+std::uint64_t contentHash(const FlattenSettings& fs) {
+	std::uint64_t hash = 0u;
+	combine(hash, fs.arcTolerance);
+	combine(hash, std::uint64_t(fs.minArcSteps));
+	combine(hash, std::uint64_t(fs.maxArcSteps));
+	combine(hash, fs.qBezTolerance);
+	combine(hash, fs.cBezTolerance);
+	return hash;
+}
+
+// FlattenCache
+std::size_t FlattenCache::KeyHash::operator()(const Key& key) const {
+	auto hash = key.subpath;
+	combine(hash, key.settings);
+	combine(hash, std::uint64_t(key.scaleBucket));
+	return std::size_t(hash);
+}
+
+FlattenCache::FlattenCache(std::size_t maxBytes) : maxBytes_(maxBytes) {
+}
+
+Span<const Vec2f> FlattenCache::flatten(const Subpath& sub,
+		const FlattenSettings& fs, float scale) {
+	return flatten(sub, contentHash(sub), fs, scale);
+}
+
+Span<const Vec2f> FlattenCache::flatten(const Subpath& sub,
+		std::uint64_t subpathHash, const FlattenSettings& fs, float scale) {
+	dlg_assert(scale > 0.f && std::isfinite(scale));
+
+	auto bucket = int(std::ceil(std::log2(scale) * bucketsPerOctave));
+	auto key = Key {subpathHash, contentHash(fs), bucket};
+	auto it = map_.find(key);
+	if(it != map_.end()) {
+		// the hashes might collide, so verify the stored content
+		auto& entry = *it->second;
+		if(same(entry.subpath, sub) && same(entry.settings, fs)) {
+			++stats_.hits;
+			entries_.splice(entries_.begin(), entries_, it->second);
+			return entry.points;
+		}
+
+		// collision, replace the entry
+		stats_.bytes -= entry.bytes;
+		--stats_.entries;
+		entries_.erase(it->second);
+		map_.erase(it);
+	}
+
+	++stats_.misses;
+
+	auto bucketScale = std::exp2(float(bucket) / bucketsPerOctave);
+	auto scaled = fs;
+	scaled.arcTolerance /= bucketScale;
+	scaled.qBezTolerance /= bucketScale;
+	scaled.cBezTolerance /= bucketScale;
+
+	auto& entry = entries_.emplace_front();
+	entry.key = key;
+	entry.subpath = sub;
+	entry.settings = fs;
+	entry.points = ktc::flatten(sub, scaled);
+
+	// approximation, includes the list and map nodes
+	entry.bytes = sizeof(Entry) + 4 * sizeof(void*) + sizeof(Key) +
+		entry.points.capacity() * sizeof(Vec2f) +
+		entry.subpath.commands.capacity() * sizeof(Command);
+
+	map_.emplace(key, entries_.begin());
+	stats_.bytes += entry.bytes;
+	++stats_.entries;
+
+	evict(1u);
+	return entry.points;
+}
+
+void FlattenCache::evict(std::size_t keep) {
+	while(stats_.bytes > maxBytes_ && entries_.size() > keep) {
+		auto& entry = entries_.back();
+		stats_.bytes -= entry.bytes;
+		--stats_.entries;
+		++stats_.evictions;
+		map_.erase(entry.key);
+		entries_.pop_back();
+	}
+}
+
+void FlattenCache::clear() {
+	map_.clear();
+	entries_.clear();
+	stats_.bytes = 0u;
+	stats_.entries = 0u;
+}
+
+void FlattenCache::maxBytes(std::size_t bytes) {
+	maxBytes_ = bytes;
+	evict(0u);
+}
+
+void FlattenCache::resetStats() {
+	stats_.hits = 0u;
+	stats_.misses = 0u;
+	stats_.evictions = 0u;
+}
+
+} // namespace ktc
@@ -0,0 +1,262 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include "flattener.hpp"
+#include <katachi/compactPath.hpp>
+#include <dlg/dlg.hpp>
+
+namespace ktc {
+namespace {
+
+/// Walks the given subpath and calls seg(to, params) for every segment.
+template<typename F>
+void forEachSegment(const CompactSubpath& sub, F&& seg) {
+	auto* p = sub.points.data() + 1;
+	auto* rotation = sub.arcRotations.data();
+	for(auto verb : sub.verbs) {
+		switch(verb) {
+			case Verb::line:
+				seg(p[0], LineParams {});
+				break;
+			case Verb::qBezier:
+				seg(p[1], QBezierParams {p[0]});
+				break;
+			case Verb::sqBezier:
+				seg(p[0], SQBezierParams {});
+				break;
+			case Verb::cBezier:
+				seg(p[2], CBezierParams {p[0], p[1]});
+				break;
+			case Verb::scBezier:
+				seg(p[1], SCBezierParams {p[0]});
+				break;
+			case Verb::arc:
+			case Verb::arcLarge:
+			case Verb::arcClockwise:
+			case Verb::arcLargeClockwise: {
+				ArcParams arc;
+				arc.radius = p[0];
+				arc.largeArc = (verb == Verb::arcLarge ||
+					verb == Verb::arcLargeClockwise);
+				arc.clockwise = (verb == Verb::arcClockwise ||
+					verb == Verb::arcLargeClockwise);
+				arc.rotation = *(rotation++);
+				seg(p[1], arc);
+				break;
+			}
+		}
+
+		p += pointCount(verb);
+	}
+
+	dlg_assert(p == sub.points.data() + sub.points.size());
+	dlg_assert(rotation == sub.arcRotations.data() + sub.arcRotations.size());
+}
+
+template<typename Out>
+void flatten(const CompactSubpath& sub, const FlattenSettings& fs,
+		const Transform& transform, Out& out) {
+	if(sub.verbs.empty()) {
+		return;
+	}
+
+	detail::Flattener<Out> flattener(fs, transform, out);
+	flattener.start(sub.points[0]);
+	forEachSegment(sub, [&](Vec2f to, const auto& params) {
+		flattener.segment(to, params);
+	});
+	flattener.finish(sub.closed);
+}
+
+Verb arcVerb(const ArcParams& arc) {
+	if(arc.largeArc) {
+		return arc.clockwise ? Verb::arcLargeClockwise : Verb::arcLarge;
+	}
+
+	return arc.clockwise ? Verb::arcClockwise : Verb::arc;
+}
+
+} // anon namespace
+
+// CompactPath
+void CompactPath::move(Vec2f to) {
+	subpaths.push_back({unsigned(verbs.size()), unsigned(points.size()),
+		unsigned(arcRotations.size()), false});
+	points.push_back(to);
+}
+
+void CompactPath::line(Vec2f to) {
+	dlg_assert(!subpaths.empty());
+	verbs.push_back(Verb::line);
+	points.push_back(to);
+}
+
+void CompactPath::arc(Vec2f to, const ArcParams& arc) {
+	dlg_assert(!subpaths.empty());
+	verbs.push_back(arcVerb(arc));
+	points.push_back(arc.radius);
+	points.push_back(to);
+	arcRotations.push_back(arc.rotation);
+}
+
+void CompactPath::qBezier(Vec2f to, const QBezierParams& bezier) {
+	dlg_assert(!subpaths.empty());
+	verbs.push_back(Verb::qBezier);
+	points.push_back(bezier.control);
+	points.push_back(to);
+}
+
+void CompactPath::sqBezier(Vec2f to) {
+	dlg_assert(!subpaths.empty());
+	verbs.push_back(Verb::sqBezier);
+	points.push_back(to);
+}
+
+void CompactPath::cBezier(Vec2f to, const CBezierParams& bezier) {
+	dlg_assert(!subpaths.empty());
+	verbs.push_back(Verb::cBezier);
+	points.push_back(bezier.control1);
+	points.push_back(bezier.control2);
+	points.push_back(to);
+}
+
+void CompactPath::scBezier(Vec2f to, const SCBezierParams& bezier) {
+	dlg_assert(!subpaths.empty());
+	verbs.push_back(Verb::scBezier);
+	points.push_back(bezier.control2);
+	points.push_back(to);
+}
+
+void CompactPath::close() {
+	dlg_assert(!subpaths.empty());
+	subpaths.back().closed = true;
+}
+
+void CompactPath::clear() {
+	verbs.clear();
+	points.clear();
+	arcRotations.clear();
+	subpaths.clear();
+}
+
+CompactSubpath CompactPath::subpath(unsigned i) const {
+	dlg_assert(i < subpaths.size());
+	auto& range = subpaths[i];
+	auto last = (i + 1 == subpaths.size());
+	auto verbEnd = last ? verbs.size() : subpaths[i + 1].verb;
+	auto pointEnd = last ? points.size() : subpaths[i + 1].point;
+	auto rotationEnd = last ? arcRotations.size() : subpaths[i + 1].arcRotation;
+
+	CompactSubpath ret;
+	ret.verbs = {verbs.data() + range.verb, verbEnd - range.verb};
+	ret.points = {points.data() + range.point, pointEnd - range.point};
+	ret.arcRotations = {arcRotations.data() + range.arcRotation,
+		rotationEnd - range.arcRotation};
+	ret.closed = range.closed;
+	return ret;
+}
+
+// conversion
+void append(CompactPath& path, const Subpath& sub) {
+	path.move(sub.start);
+	auto commandAppender = [&](Vec2f to, auto& p) {
+		using T = std::decay_t<decltype(p)>;
+		if constexpr(std::is_same_v<T, LineParams>) {
+			path.line(to);
+		} else if constexpr(std::is_same_v<T, QBezierParams>) {
+			path.qBezier(to, p);
+		} else if constexpr(std::is_same_v<T, SQBezierParams>) {
+			path.sqBezier(to);
+		} else if constexpr(std::is_same_v<T, CBezierParams>) {
+			path.cBezier(to, p);
+		} else if constexpr(std::is_same_v<T, SCBezierParams>) {
+			path.scBezier(to, p);
+		} else if constexpr(std::is_same_v<T, ArcParams>) {
+			path.arc(to, p);
+		}
+	};
+
+	for(auto& cmd : sub.commands) {
+		visit([&](auto& p) { commandAppender(cmd.to, p); }, cmd.params);
+	}
+
+	if(sub.closed) {
+		path.close();
+	}
+}
+
+CompactPath compact(const Path& path, std::pmr::memory_resource* memory) {
+	auto verbs = 0u;
+	auto points = 0u;
+	for(auto& sub : path.subpaths) {
+		verbs += sub.commands.size();
+		points += 1 + 3 * sub.commands.size();
+	}
+
+	CompactPath ret(memory);
+	ret.verbs.reserve(verbs);
+	ret.points.reserve(points); // upper bound
+	ret.subpaths.reserve(path.subpaths.size());
+	for(auto& sub : path.subpaths) {
+		append(ret, sub);
+	}
+
+	return ret;
+}
+
+Subpath expand(const CompactSubpath& sub, std::pmr::memory_resource* memory) {
+	Subpath ret(memory);
+	ret.start = sub.points.empty() ? Vec2f {} : sub.points[0];
+	ret.closed = sub.closed;
+	ret.commands.reserve(sub.verbs.size());
+	forEachSegment(sub, [&](Vec2f to, const auto& params) {
+		ret.commands.push_back({to, params});
+	});
+
+	return ret;
+}
+
+Path expand(const CompactPath& path, std::pmr::memory_resource* memory) {
+	Path ret(memory);
+	ret.subpaths.reserve(path.size());
+	for(auto i = 0u; i < path.size(); ++i) {
+		ret.subpaths.push_back(expand(path.subpath(i), memory));
+	}
+
+	return ret;
+}
+
+// flatten
+unsigned flattenedPointCount(const CompactSubpath& sub,
+		const FlattenSettings& fs, const Transform& transform) {
+	detail::CountOutput out;
+	flatten(sub, fs, transform, out);
+	return out.count;
+}
+
+unsigned flatten(const CompactSubpath& sub, Span<Vec2f> points,
+		const FlattenSettings& fs, const Transform& transform) {
+	detail::SpanOutput out {points};
+	flatten(sub, fs, transform, out);
+	return out.count;
+}
+
+void flatten(const CompactSubpath& sub, std::vector<Vec2f>& points,
+		const FlattenSettings& fs, const Transform& transform) {
+	detail::VectorOutput<> out {points};
+	flatten(sub, fs, transform, out);
+}
+
+void flatten(const CompactPath& path, FlattenedPath& out,
+		const FlattenSettings& fs, const Transform& transform,
+		const ParallelForFn& parallelFor) {
+	detail::flattenSubpaths(path.size(), out, parallelFor,
+		[&](unsigned i) {
+			return flattenedPointCount(path.subpath(i), fs, transform);
+		}, [&](unsigned i, Span<Vec2f> points) {
+			flatten(path.subpath(i), points, fs, transform);
+		});
+}
+
+} // namespace ktc
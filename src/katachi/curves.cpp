@@ -5,11 +5,80 @@
 #include <katachi/curves.hpp>
 #include <nytl/math.hpp>
 #include <nytl/vecOps.hpp>
+#include <dlg/dlg.hpp>
+#include <algorithm>
+#include <functional>
 #include <cmath>
 
+#if defined(__SSE2__) || defined(_M_X64)
+	#define KTC_SIMD_SSE2
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	#define KTC_SIMD_NEON
+	#include <arm_neon.h>
+#endif
+
 namespace ktc {
 namespace {
 
+// Minimal 4-wide float vector used by the batched flatten functions.
+// Falls back to plain arrays (that might still get auto-vectorized)
+// when neither SSE2 nor NEON are available.
+// In its own namespace so the operators don't hide other overloads.
+namespace simd {
+
+#if defined(KTC_SIMD_SSE2)
+	struct F4 { __m128 v; };
+	F4 f4(float a) { return {_mm_set1_ps(a)}; }
+	F4 f4(float a, float b, float c, float d) { return {_mm_setr_ps(a, b, c, d)}; }
+	F4 operator+(F4 a, F4 b) { return {_mm_add_ps(a.v, b.v)}; }
+	F4 operator-(F4 a, F4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+	F4 operator*(F4 a, F4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+	F4 operator/(F4 a, F4 b) { return {_mm_div_ps(a.v, b.v)}; }
+	F4 sqrt(F4 a) { return {_mm_sqrt_ps(a.v)}; }
+	F4 max(F4 a, F4 b) { return {_mm_max_ps(a.v, b.v)}; }
+	void store(F4 a, float* out) { _mm_storeu_ps(out, a.v); }
+#elif defined(KTC_SIMD_NEON)
+	struct F4 { float32x4_t v; };
+	F4 f4(float a) { return {vdupq_n_f32(a)}; }
+	F4 f4(float a, float b, float c, float d) {
+		float v[4] = {a, b, c, d};
+		return {vld1q_f32(v)};
+	}
+	F4 operator+(F4 a, F4 b) { return {vaddq_f32(a.v, b.v)}; }
+	F4 operator-(F4 a, F4 b) { return {vsubq_f32(a.v, b.v)}; }
+	F4 operator*(F4 a, F4 b) { return {vmulq_f32(a.v, b.v)}; }
+	F4 operator/(F4 a, F4 b) { return {vdivq_f32(a.v, b.v)}; }
+	F4 sqrt(F4 a) { return {vsqrtq_f32(a.v)}; }
+	F4 max(F4 a, F4 b) { return {vmaxq_f32(a.v, b.v)}; }
+	void store(F4 a, float* out) { vst1q_f32(out, a.v); }
+#else
+	struct F4 { float v[4]; };
+	F4 f4(float a) { return {{a, a, a, a}}; }
+	F4 f4(float a, float b, float c, float d) { return {{a, b, c, d}}; }
+
+	template<typename F>
+	F4 map(F4 a, F4 b, F&& f) {
+		for(auto i = 0u; i < 4u; ++i) {
+			a.v[i] = f(a.v[i], b.v[i]);
+		}
+		return a;
+	}
+
+	F4 operator+(F4 a, F4 b) { return map(a, b, std::plus<float>{}); }
+	F4 operator-(F4 a, F4 b) { return map(a, b, std::minus<float>{}); }
+	F4 operator*(F4 a, F4 b) { return map(a, b, std::multiplies<float>{}); }
+	F4 operator/(F4 a, F4 b) { return map(a, b, std::divides<float>{}); }
+	F4 sqrt(F4 a) { return map(a, a, [](float x, float) { return std::sqrt(x); }); }
+	F4 max(F4 a, F4 b) { return map(a, b, [](float x, float y) { return std::max(x, y); }); }
+	void store(F4 a, float* out) { std::copy(a.v, a.v + 4, out); }
+#endif
+
+} // namespace simd
+
+using simd::F4;
+using simd::f4;
+
 /// 2-dimensional cross product.
 /// Is the same as the dot of a with the normal of b.
 template<typename T>
@@ -22,43 +91,334 @@ Vec2f unitCirclePoint(float angle) {
 	return {std::cos(angle), std::sin(angle)};
 }
 
-/// Simple de Casteljau implementation.
-/// See antigrain.com/research/adaptive_bezier/
-void subdivide(const CubicBezier& bezier, unsigned maxlvl, unsigned lvl,
-		std::vector<nytl::Vec2f>& points, float minSubdiv) {
+/// Returns the point on the given arc for the given angle.
+Vec2f arcPoint(const CenterArc& arc, float angle) {
+	auto p = unitCirclePoint(angle);
+	p.x *= std::abs(arc.radius.x);
+	p.y *= std::abs(arc.radius.y);
 
-	if(lvl > maxlvl) {
-		return;
+	auto rot = unitCirclePoint(arc.rotation);
+	return arc.center + Vec2f {rot.x * p.x - rot.y * p.y,
+		rot.y * p.x + rot.x * p.y};
+}
+
+/// Upper bound for the number of segments a single curve is flattened into.
+/// Guards against degenerate input (e.g. non-finite control points).
+constexpr auto maxCurveSegments = 1024u;
+
+/// Rounds the given (estimated) number of segments up and clamps it
+/// into the valid range. Returns 1 for NaN.
+template<typename T>
+unsigned segmentCount(T count) {
+	count = std::ceil(count);
+	if(!(count > 1)) {
+		return 1u;
+	}
+
+	return count < maxCurveSegments ? unsigned(count) : maxCurveSegments;
+}
+
+// Approximations of the integral of (1 + 4x^2)^(-1/4) and its inverse.
+// See raphlinus.github.io/graphics/curves/2019/12/23/flatten-quadbez.html
+double approxParabolaIntegral(double x) {
+	constexpr auto d = 0.67;
+	return x / (1 - d + std::sqrt(std::sqrt(d * d * d * d + 0.25 * x * x)));
+}
+
+double approxParabolaInvIntegral(double x) {
+	constexpr auto b = 0.39;
+	return x * (1 - b + std::sqrt(b * b + 0.25 * x * x));
+}
+
+/// Subdivision parameters of a quadratic bezier curve mapped to a
+/// segment of the parabola y = x^2.
+struct ParabolaParams {
+	double a0, a2; // parabola integral at start and end
+	double u0, uscale; // parameter mapping from integral space back to t
+	unsigned count; // number of segments
+};
+
+ParabolaParams parabolaParams(const QuadBezier& b, float tolerance) {
+	auto d01 = Vec2<double>{b.control.x - b.start.x, b.control.y - b.start.y};
+	auto d12 = Vec2<double>{b.end.x - b.control.x, b.end.y - b.control.y};
+	auto dd = d01 - d12;
+	auto d02 = d01 + d12;
+	auto c = cross(d02, dd);
+
+	// x0, x2: start and end of the parabola segment
+	auto x0 = dot(d01, dd) / c;
+	auto x2 = dot(d12, dd) / c;
+	auto scale = std::abs(c / (length(dd) * (x2 - x0)));
+
+	ParabolaParams ret;
+	ret.a0 = approxParabolaIntegral(x0);
+	ret.a2 = approxParabolaIntegral(x2);
+
+	// For (almost) straight lines the parameters aren't finite. We can
+	// just emit a single segment then.
+	auto val = 0.0;
+	auto sqrtTol = std::sqrt(double(tolerance));
+	if(std::isfinite(scale)) {
+		auto da = std::abs(ret.a2 - ret.a0);
+		auto sqrtScale = std::sqrt(scale);
+		if((x0 < 0) == (x2 < 0)) {
+			val = da * sqrtScale;
+		} else {
+			// the segment contains the cusp, i.e. curvature maximum
+			auto xmin = sqrtTol / sqrtScale;
+			val = sqrtTol * da / approxParabolaIntegral(xmin);
+		}
+	}
+
+	ret.count = segmentCount(0.5 * val / sqrtTol);
+
+	auto u0 = approxParabolaInvIntegral(ret.a0);
+	auto u2 = approxParabolaInvIntegral(ret.a2);
+	ret.u0 = u0;
+	ret.uscale = 1 / (u2 - u0);
+	return ret;
+}
+
+/// Returns the number of segments needed to flatten the given cubic
+/// bezier with the given tolerance, using Wang's formula.
+unsigned cubicSegments(const CubicBezier& b, float tolerance) {
+	auto dd1 = b.start - 2 * b.control1 + b.control2;
+	auto dd2 = b.control1 - 2 * b.control2 + b.end;
+	auto m = std::sqrt(std::max(dot(dd1, dd1), dot(dd2, dd2)));
+	return segmentCount(std::sqrt(0.75f * m / tolerance));
+}
+
+/// Writes the count points of the given curve into out, using
+/// forward differencing with evenly spaced parameters.
+void flatten(const CubicBezier& b, unsigned count, Vec2f* out) {
+	using Vec2d = Vec2<double>;
+	auto p0 = Vec2d{b.start.x, b.start.y};
+	auto p1 = Vec2d{b.control1.x, b.control1.y};
+	auto p2 = Vec2d{b.control2.x, b.control2.y};
+	auto p3 = Vec2d{b.end.x, b.end.y};
+
+	// polynomial coefficients: a * t^3 + b * t^2 + c * t + p0
+	auto ca = p3 - p0 + 3.0 * (p1 - p2);
+	auto cb = 3.0 * (p0 - 2.0 * p1 + p2);
+	auto cc = 3.0 * (p1 - p0);
+
+	auto h = 1.0 / count;
+	auto h2 = h * h;
+	auto h3 = h2 * h;
+
+	auto f = p0;
+	auto df = h3 * ca + h2 * cb + h * cc;
+	auto ddf = (6 * h3) * ca + (2 * h2) * cb;
+	auto dddf = (6 * h3) * ca;
+
+	for(auto i = 1u; i < count; ++i) {
+		f += df;
+		df += ddf;
+		ddf += dddf;
+		*(out++) = {float(f.x), float(f.y)};
+	}
+
+	*out = b.end;
+}
+
+/// Writes the params.count points of the given curve into out.
+void flatten(const QuadBezier& b, const ParabolaParams& params, Vec2f* out) {
+	auto da = (params.a2 - params.a0) / params.count;
+	for(auto i = 1u; i < params.count; ++i) {
+		auto u = approxParabolaInvIntegral(params.a0 + i * da);
+		auto t = float((u - params.u0) * params.uscale);
+		auto mt = 1 - t;
+		*(out++) = (mt * mt) * b.start + (2 * mt * t) * b.control +
+			(t * t) * b.end;
+	}
+
+	*out = b.end;
+}
+
+/// Returns the transformation of the unit circle onto the (transformed)
+/// ellipse of the given arc.
+Transform ellipseTransform(const CenterArc& arc, const Transform& transform) {
+	auto rot = unitCirclePoint(arc.rotation);
+	auto ellipse = Transform {
+		std::abs(arc.radius.x) * rot,
+		std::abs(arc.radius.y) * Vec2f {-rot.y, rot.x},
+		arc.center
+	};
+
+	return transform * ellipse;
+}
+
+/// Writes the given number of evenly spaced steps of the arc into out.
+/// Instead of evaluating sin and cos for every step, the point on the
+/// unit circle is rotated by the step angle in every iteration.
+/// The recurrence runs in double precision to not accumulate errors.
+void flatten(const CenterArc& arc, unsigned steps, const Transform& transform,
+		Vec2f* out) {
+	auto ellipse = ellipseTransform(arc, transform);
+	auto ax = ellipse.x;
+	auto ay = ellipse.y;
+	auto center = ellipse.translation;
+
+	auto step = double(arc.end - arc.start) / steps;
+	auto cstep = std::cos(step), sstep = std::sin(step);
+	auto c = std::cos(double(arc.start)), s = std::sin(double(arc.start));
+	for(auto i = 0u; i < steps; ++i) {
+		auto nc = c * cstep - s * sstep;
+		s = s * cstep + c * sstep;
+		c = nc;
+		*(out++) = center + float(c) * ax + float(s) * ay;
+	}
+}
+
+/// Loads the given coordinate of a control point of 4 consecutive curves.
+template<typename B>
+F4 lanes(const B* b, Vec2f B::* point, unsigned coord) {
+	return f4((b[0].*point)[coord], (b[1].*point)[coord],
+		(b[2].*point)[coord], (b[3].*point)[coord]);
+}
+
+/// Like cubicSegments, but for 4 curves at once.
+void cubicSegments4(const CubicBezier* b, float tolerance, unsigned* out) {
+	auto two = f4(2.f);
+	auto dd1x = lanes(b, &CubicBezier::start, 0) -
+		two * lanes(b, &CubicBezier::control1, 0) +
+		lanes(b, &CubicBezier::control2, 0);
+	auto dd1y = lanes(b, &CubicBezier::start, 1) -
+		two * lanes(b, &CubicBezier::control1, 1) +
+		lanes(b, &CubicBezier::control2, 1);
+	auto dd2x = lanes(b, &CubicBezier::control1, 0) -
+		two * lanes(b, &CubicBezier::control2, 0) +
+		lanes(b, &CubicBezier::end, 0);
+	auto dd2y = lanes(b, &CubicBezier::control1, 1) -
+		two * lanes(b, &CubicBezier::control2, 1) +
+		lanes(b, &CubicBezier::end, 1);
+
+	auto m = sqrt(max(dd1x * dd1x + dd1y * dd1y, dd2x * dd2x + dd2y * dd2y));
+	auto counts = sqrt(f4(0.75f) * m / f4(tolerance));
+
+	float c[4];
+	store(counts, c);
+	for(auto i = 0u; i < 4u; ++i) {
+		out[i] = segmentCount(c[i]);
 	}
+}
+
+/// Like flatten(CubicBezier, unsigned, Vec2f*) but evaluates 4 points
+/// at once (directly, using horner's method).
+void flatten4(const CubicBezier& b, unsigned count, Vec2f* out) {
+	// polynomial coefficients: a * t^3 + b * t^2 + c * t + p0
+	auto ca = b.end - b.start + 3 * (b.control1 - b.control2);
+	auto cb = 3 * (b.start - 2 * b.control1 + b.control2);
+	auto cc = 3 * (b.control1 - b.start);
+
+	auto ax = f4(ca.x), bx = f4(cb.x), cx = f4(cc.x), px = f4(b.start.x);
+	auto ay = f4(ca.y), by = f4(cb.y), cy = f4(cc.y), py = f4(b.start.y);
+	auto h = f4(1.f / count);
+
+	float xs[4], ys[4];
+	for(auto i = 1u; i < count; i += 4) {
+		auto t = h * f4(i, i + 1, i + 2, i + 3);
+		store(((ax * t + bx) * t + cx) * t + px, xs);
+		store(((ay * t + by) * t + cy) * t + py, ys);
 
-	auto p1 = bezier.start;
-	auto p2 = bezier.control1;
-	auto p3 = bezier.control2;
-	auto p4 = bezier.end;
+		auto n = std::min(4u, count - i);
+		for(auto j = 0u; j < n; ++j) {
+			*(out++) = {xs[j], ys[j]};
+		}
+	}
 
-	auto d = p4 - p1;
-	auto d2 = std::abs(cross(p2 - p4, d));
-	auto d3 = std::abs(cross(p3 - p4, d));
+	*out = b.end;
+}
 
-	if((d2 + d3) * (d2 + d3) <= minSubdiv * dot(d, d)) {
-		points.push_back(p4);
+/// Like flatten(QuadBezier, ParabolaParams, Vec2f*) but evaluates 4 points
+/// at once.
+void flatten4(const QuadBezier& b, const ParabolaParams& params, Vec2f* out) {
+	// The parameter mapping is evaluated in single precision here which
+	// is only accurate enough for well-conditioned parabola segments.
+	// For (almost straight) curves mapped to far out parabola segments,
+	// use the double precision implementation.
+	if(std::abs(params.u0 * params.uscale) > 64.0) {
+		flatten(b, params, out);
 		return;
 	}
 
-	auto p12 = 0.5f * (p1 + p2);
-	auto p23 = 0.5f * (p2 + p3);
-	auto p34 = 0.5f * (p3 + p4);
-	auto p123 = 0.5f * (p12 + p23);
+	constexpr auto pb = 0.39f; // see approxParabolaInvIntegral
+	auto k0 = f4(1 - pb);
+	auto k1 = f4(pb * pb);
+	auto quarter = f4(0.25f);
+
+	auto a0 = f4(params.a0);
+	auto da = f4((params.a2 - params.a0) / params.count);
+	auto u0 = f4(params.u0);
+	auto uscale = f4(params.uscale);
+
+	// polynomial coefficients: a * t^2 + b * t + p0
+	auto ca = b.start - 2 * b.control + b.end;
+	auto cb = 2 * (b.control - b.start);
+	auto ax = f4(ca.x), bx = f4(cb.x), px = f4(b.start.x);
+	auto ay = f4(ca.y), by = f4(cb.y), py = f4(b.start.y);
 
-	auto p234 = 0.5f * (p23 + p34);
-	auto p1234 = 0.5f * (p123 + p234);
+	float xs[4], ys[4];
+	for(auto i = 1u; i < params.count; i += 4) {
+		auto a = a0 + da * f4(i, i + 1, i + 2, i + 3);
+		auto u = a * (k0 + sqrt(k1 + quarter * a * a));
+		auto t = (u - u0) * uscale;
+		store((ax * t + bx) * t + px, xs);
+		store((ay * t + by) * t + py, ys);
 
-	subdivide({p1, p12, p123, p1234}, maxlvl, lvl + 1, points, minSubdiv);
-	subdivide({p1234, p234, p34, p4}, maxlvl, lvl + 1, points, minSubdiv);
+		auto n = std::min(4u, params.count - i);
+		for(auto j = 0u; j < n; ++j) {
+			*(out++) = {xs[j], ys[j]};
+		}
+	}
+
+	*out = b.end;
+}
+
+/// Appends the flattened cubic bezier to the given vector.
+template<typename V>
+void append(const CubicBezier& bezier, V& points, float tolerance) {
+	dlg_assert(tolerance > 0.f);
+	auto count = cubicSegments(bezier, tolerance);
+	auto size = points.size();
+	points.resize(size + count);
+	flatten(bezier, count, points.data() + size);
+}
+
+/// Appends the flattened quadratic bezier to the given vector.
+template<typename V>
+void append(const QuadBezier& bezier, V& points, float tolerance) {
+	dlg_assert(tolerance > 0.f);
+	auto params = parabolaParams(bezier, tolerance);
+	auto size = points.size();
+	points.resize(size + params.count);
+	flatten(bezier, params, points.data() + size);
+}
+
+/// Turns the segment counts in offsets[1...] into the offsets of the
+/// first point of each curve and resizes points accordingly.
+void prepareBatch(std::vector<unsigned>& offsets, std::vector<Vec2f>& points) {
+	offsets[0] = 0u;
+	for(auto i = 1u; i < offsets.size(); ++i) {
+		offsets[i] += offsets[i - 1];
+	}
+
+	points.resize(offsets.back());
 }
 
 } // anon namespace
 
+Vec2f apply(const Transform& t, Vec2f p) {
+	return p.x * t.x + p.y * t.y + t.translation;
+}
+
+float maxScale(const Transform& t) {
+	// closed form of the largest singular value of a 2x2 matrix
+	auto s = dot(t.x, t.x) + dot(t.y, t.y);
+	auto d = cross(t.x, t.y);
+	return std::sqrt(0.5f * (s + std::sqrt(std::max(s * s - 4 * d * d, 0.f))));
+}
+
 // stackoverflow.com/questions/3162645/convert-a-quadratic-bezier-to-a-cubic
 CubicBezier quadToCubic(const QuadBezier& b) {
 	return {b.start,
@@ -67,42 +427,146 @@ CubicBezier quadToCubic(const QuadBezier& b) {
 		b.end};
 }
 
-void flatten(const CubicBezier& bezier, std::vector<Vec2f>& p,
-		unsigned maxLevel, float minDist) {
-	subdivide(bezier, maxLevel, 0, p, minDist);
+unsigned flattenedPointCount(const CubicBezier& bezier, float tolerance) {
+	dlg_assert(tolerance > 0.f);
+	return cubicSegments(bezier, tolerance);
 }
 
-void flatten(const QuadBezier& bezier, std::vector<Vec2f>& p,
-		unsigned maxLevel, float minDist) {
-	return flatten(quadToCubic(bezier), p, maxLevel, minDist);
+void flatten(const CubicBezier& bezier, std::vector<Vec2f>& points,
+		float tolerance) {
+	append(bezier, points, tolerance);
 }
 
-// Arc implementations from
-// www.w3.org/TR/SVG/implnote.html#ArcImplementationNotes
-void flatten(const CenterArc& arc, std::vector<Vec2f>& points, unsigned steps) {
-	using namespace nytl::vec::cw::operators;
+void flatten(const CubicBezier& bezier, std::pmr::vector<Vec2f>& points,
+		float tolerance) {
+	append(bezier, points, tolerance);
+}
+
+unsigned flattenedPointCount(const QuadBezier& bezier, float tolerance) {
+	dlg_assert(tolerance > 0.f);
+	return parabolaParams(bezier, tolerance).count;
+}
 
-	// Currently no x-axis rotation possible
-	auto delta = arc.end - arc.start;
-	points.reserve(points.size() + steps);
-	auto r = Vec {std::abs(arc.radius.x), std::abs(arc.radius.y)};
-	for(auto i = 1u; i <= steps; ++i) {
-		auto angle = arc.start + i * (delta / steps);
-		points.push_back(r * unitCirclePoint(angle) + arc.center);
+void flatten(const QuadBezier& bezier, std::vector<Vec2f>& points,
+		float tolerance) {
+	append(bezier, points, tolerance);
+}
+
+void flatten(const QuadBezier& bezier, std::pmr::vector<Vec2f>& points,
+		float tolerance) {
+	append(bezier, points, tolerance);
+}
+
+unsigned flatten(const CubicBezier& bezier, Span<Vec2f> out, float tolerance) {
+	dlg_assert(tolerance > 0.f);
+	auto count = cubicSegments(bezier, tolerance);
+	dlg_assert(out.size() >= count);
+	flatten(bezier, count, out.data());
+	return count;
+}
+
+unsigned flatten(const QuadBezier& bezier, Span<Vec2f> out, float tolerance) {
+	dlg_assert(tolerance > 0.f);
+	auto params = parabolaParams(bezier, tolerance);
+	dlg_assert(out.size() >= params.count);
+	flatten(bezier, params, out.data());
+	return params.count;
+}
+
+void flattenBatch(Span<const CubicBezier> curves, std::vector<Vec2f>& points,
+		std::vector<unsigned>& offsets, float tolerance) {
+	dlg_assert(tolerance > 0.f);
+
+	auto count = unsigned(curves.size());
+	offsets.resize(count + 1);
+
+	auto i = 0u;
+	for(; i + 4 <= count; i += 4) {
+		cubicSegments4(&curves[i], tolerance, &offsets[i + 1]);
+	}
+
+	for(; i < count; ++i) {
+		offsets[i + 1] = cubicSegments(curves[i], tolerance);
+	}
+
+	prepareBatch(offsets, points);
+	for(i = 0u; i < count; ++i) {
+		auto segments = offsets[i + 1] - offsets[i];
+		flatten4(curves[i], segments, points.data() + offsets[i]);
+	}
+}
+
+void flattenBatch(Span<const QuadBezier> curves, std::vector<Vec2f>& points,
+		std::vector<unsigned>& offsets, float tolerance) {
+	dlg_assert(tolerance > 0.f);
+
+	// The curves are processed in chunks whose parameters are kept
+	// between counting and writing, so they are only computed once.
+	constexpr auto chunkSize = 64u;
+	ParabolaParams params[chunkSize];
+
+	auto count = unsigned(curves.size());
+	offsets.resize(count + 1);
+	offsets[0] = 0u;
+	for(auto c = 0u; c < count; c += chunkSize) {
+		auto n = std::min(chunkSize, count - c);
+		for(auto i = 0u; i < n; ++i) {
+			params[i] = parabolaParams(curves[c + i], tolerance);
+			offsets[c + i + 1] = offsets[c + i] + params[i].count;
+		}
+
+		points.resize(offsets[c + n]);
+		for(auto i = 0u; i < n; ++i) {
+			flatten4(curves[c + i], params[i], points.data() + offsets[c + i]);
+		}
 	}
+
+	points.resize(offsets[count]);
+}
+
+unsigned flattenedPointCount(const CenterArc& arc, float tolerance,
+		const Transform& transform) {
+	dlg_assert(tolerance > 0.f);
+
+	// The distance between the arc and a chord spanning the angle step
+	// is at most r * (1 - cos(step / 2)), r being the larger radius
+	// of the (transformed) ellipse.
+	// Computed in double precision since acos is ill-conditioned near 1.
+	auto r = maxScale(ellipseTransform(arc, transform));
+	auto c = std::clamp(1.0 - double(tolerance) / r, -1.0, 1.0);
+	auto maxStep = 2 * std::acos(c);
+	return segmentCount(std::abs(arc.end - arc.start) / maxStep);
 }
 
+void flatten(const CenterArc& arc, std::vector<Vec2f>& points, unsigned steps,
+		const Transform& transform) {
+	auto size = points.size();
+	points.resize(size + steps);
+	flatten(arc, steps, transform, points.data() + size);
+}
+
+void flatten(const CenterArc& arc, Span<Vec2f> out,
+		const Transform& transform) {
+	flatten(arc, unsigned(out.size()), transform, out.data());
+}
+
+// Arc implementations from
 // https://www.w3.org/TR/SVG/implnote.html#ArcImplementationNotes
 CenterArc endToCenter(const EndArc& arc) {
 	auto r = Vec2f {std::abs(arc.radius.x), std::abs(arc.radius.y)};
+	auto rot = unitCirclePoint(arc.rotation);
 
 	// step 1 (p = (x', y'))
-	auto p = 0.5f * (arc.from - arc.to);
-	if(p == Vec2f {0.f, 0.f}) {
-		// endpoints identical: emit the arc completly
-		return {{}, r, 0.f, 0.f};
+	auto d = 0.5f * (arc.from - arc.to);
+	if(d == Vec2f {0.f, 0.f}) {
+		// endpoints identical: degenerate arc only consisting of from
+		auto ret = CenterArc {{}, r, 0.f, 0.f, arc.rotation};
+		ret.center = arc.from - arcPoint(ret, 0.f);
+		return ret;
 	}
 
+	auto p = Vec2f {rot.x * d.x + rot.y * d.y, -rot.y * d.x + rot.x * d.y};
+
 	// squared values
 	auto rxs = r.x * r.x, rys = r.y * r.y, pys = p.y * p.y, pxs = p.x * p.x;
 
@@ -115,20 +579,21 @@ CenterArc endToCenter(const EndArc& arc) {
 	}
 
 	// step2 (tc = (cx', cy'))
+	// inner might be slightly negative due to rounding after correction
 	auto inner = (rxs * rys - rxs * pys - rys * pxs) / (rxs * pys + rys * pxs);
 	auto sign = (arc.largeArc != arc.clockwise) ? 1 : -1;
 	auto mult = Vec {r.x * p.y / r.y, -r.y * p.x / r.x};
-	auto tc = sign * std::sqrt(inner) * mult;
+	auto tc = sign * std::sqrt(std::max(inner, 0.f)) * mult;
 
 	// step3: center
-	auto c = tc;
-	c += Vec2f{(arc.from.x + arc.to.x) / 2, (arc.from.y + arc.to.y) / 2};
+	auto c = Vec2f {rot.x * tc.x - rot.y * tc.y, rot.y * tc.x + rot.x * tc.y};
+	c += 0.5f * (arc.from + arc.to);
 
 	// step4: angles
 	auto vec1 = Vec {(p.x - tc.x) / r.x, (p.y - tc.y) / r.y};
 	auto vec2 = Vec {(-p.x - tc.x) / r.x, (-p.y - tc.y) / r.y};
-	auto angle1 = angle(Vec2f{1, 0}, vec1);
-	auto delta = float(std::fmod(angle(vec1, vec2), 2 * nytl::constants::pi));
+	auto angle1 = std::atan2(vec1.y, vec1.x);
+	auto delta = std::atan2(cross(vec1, vec2), dot(vec1, vec2));
 
 	if(!arc.clockwise && delta > 0) {
 		delta -= 2 * nytl::constants::pi;
@@ -136,15 +601,13 @@ CenterArc endToCenter(const EndArc& arc) {
 		delta += 2 * nytl::constants::pi;
 	}
 
-	return {c, arc.radius, angle1, angle1 + delta};
+	return {c, r, angle1, angle1 + delta, arc.rotation};
 }
 
 EndArc centerToEnd(const CenterArc& arc) {
-	using namespace nytl::vec::cw::operators;
-
-	auto ret = EndArc { arc.center, arc.center, arc.radius, {}, {}};
-	ret.from += arc.radius * Vec2f {std::cos(arc.start), std::sin(arc.start)};
-	ret.to += arc.radius * Vec2f {std::cos(arc.end), std::sin(arc.end)};
+	auto ret = EndArc {{}, {}, arc.radius, {}, {}, arc.rotation};
+	ret.from = arcPoint(arc, arc.start);
+	ret.to = arcPoint(arc, arc.end);
 	ret.largeArc = std::abs(arc.end - arc.start) > nytl::constants::pi;
 	ret.clockwise = arc.end - arc.start > 0.f;
 	return ret;
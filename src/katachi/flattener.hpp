@@ -0,0 +1,233 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+// Internal header, shared implementation of the different path
+// representations' flatten functions.
+
+#pragma once
+
+#include "record.hpp"
+#include <katachi/path.hpp>
+#include <katachi/curves.hpp>
+#include <nytl/vecOps.hpp>
+#include <dlg/dlg.hpp>
+#include <algorithm>
+#include <type_traits>
+
+namespace ktc::detail {
+
+// Outputs for the Flattener below.
+// Curves are forwarded to the matching flatten function so that
+// parameters for the curves are only computed once.
+// Only the writing outputs record stats, so that counting and then
+// writing (as flattenSubpaths does) records every point once.
+
+/// Only counts the points.
+struct CountOutput {
+	unsigned count {};
+
+	void point(Vec2f) {
+		++count;
+	}
+
+	template<typename C>
+	void curve(const C& curve, float tolerance) {
+		count += flattenedPointCount(curve, tolerance);
+	}
+
+	void arc(const CenterArc&, unsigned steps, Vec2f, const Transform&) {
+		count += steps;
+	}
+};
+
+/// Writes the points into a span that is large enough.
+struct SpanOutput {
+	Span<Vec2f> points;
+	unsigned count {};
+
+	Span<Vec2f> rest() const {
+		return {points.data() + count, points.size() - count};
+	}
+
+	void point(Vec2f p) {
+		dlg_assert(count < points.size());
+		points[count++] = p;
+		KTC_STAT(linePoints++);
+	}
+
+	template<typename C>
+	void curve(const C& curve, float tolerance) {
+		auto written = flatten(curve, rest(), tolerance);
+		count += written;
+		record(curve, written);
+	}
+
+	void arc(const CenterArc& arc, unsigned steps, Vec2f to,
+			const Transform& transform) {
+		dlg_assert(count + steps <= points.size());
+		flatten(arc, Span<Vec2f>(points.data() + count, steps), transform);
+		count += steps;
+		points[count - 1] = to;
+		record(arc, steps);
+	}
+};
+
+/// Appends the points to a vector.
+template<typename V = std::vector<Vec2f>>
+struct VectorOutput {
+	V& points;
+
+	void point(Vec2f p) {
+		points.push_back(p);
+		KTC_STAT(linePoints++);
+	}
+
+	template<typename C>
+	void curve(const C& curve, float tolerance) {
+		auto offset = points.size();
+		flatten(curve, points, tolerance);
+		record(curve, unsigned(points.size() - offset));
+	}
+
+	void arc(const CenterArc& arc, unsigned steps, Vec2f to,
+			const Transform& transform) {
+		auto offset = points.size();
+		points.resize(offset + steps);
+		flatten(arc, Span<Vec2f>(points.data() + offset, steps), transform);
+		points.back() = to;
+		record(arc, steps);
+	}
+};
+
+/// Flattens a sequence of segments into the given output.
+/// Keeps track of the current point and the last control points to
+/// resolve smooth curves.
+/// Applies the transform to the control points of the curves, which
+/// means that the tolerances will be in transformed (device) space.
+template<typename Out>
+class Flattener {
+public:
+	Flattener(const FlattenSettings& fs, const Transform& transform, Out& out)
+		: fs_(fs), transform_(transform), out_(out) {}
+
+	/// Starts a new subpath at the given point.
+	void start(Vec2f start) {
+		start_ = current_ = lastControlQ_ = lastControlC_ = start;
+		out_.point(t(start));
+	}
+
+	/// Ends the current subpath. If it is closed, outputs its start point.
+	void finish(bool closed) {
+		if(closed) {
+			out_.point(t(start_));
+		}
+	}
+
+	/// Returns the current point, i.e. the end of the last segment.
+	Vec2f current() const { return current_; }
+
+	/// Returns the control points a smooth quadratic/cubic bezier
+	/// segment starting at the current point would use.
+	Vec2f smoothControlQ() const { return mirror(current_, lastControlQ_); }
+	Vec2f smoothControlC() const { return mirror(current_, lastControlC_); }
+
+	/// Outputs the segment from the current point to the given one.
+	template<typename P>
+	void segment(Vec2f to, const P& p) {
+		if constexpr(std::is_same_v<P, LineParams>) {
+			out_.point(t(to));
+			lastControlC_ = lastControlQ_ = to;
+		} else if constexpr(std::is_same_v<P, QBezierParams>) {
+			auto b = QuadBezier {t(current_), t(p.control), t(to)};
+			out_.curve(b, fs_.qBezTolerance);
+			lastControlQ_ = p.control;
+			lastControlC_ = to;
+		} else if constexpr(std::is_same_v<P, SQBezierParams>) {
+			lastControlQ_ = smoothControlQ();
+			auto b = QuadBezier {t(current_), t(lastControlQ_), t(to)};
+			out_.curve(b, fs_.qBezTolerance);
+			lastControlC_ = to;
+		} else if constexpr(std::is_same_v<P, CBezierParams>) {
+			auto b = CubicBezier {t(current_), t(p.control1), t(p.control2),
+				t(to)};
+			out_.curve(b, fs_.cBezTolerance);
+			lastControlQ_ = to;
+			lastControlC_ = p.control2;
+		} else if constexpr(std::is_same_v<P, SCBezierParams>) {
+			auto control = smoothControlC();
+			auto b = CubicBezier {t(current_), t(control), t(p.control2),
+				t(to)};
+			out_.curve(b, fs_.cBezTolerance);
+			lastControlQ_ = to;
+			lastControlC_ = p.control2;
+		} else if constexpr(std::is_same_v<P, ArcParams>) {
+			// if a radius is zero draw a straight line, if the endpoints
+			// are identical omit the arc (see svg spec, F.6.2)
+			if(p.radius.x == 0.f || p.radius.y == 0.f) {
+				out_.point(t(to));
+			} else if(current_ != to) {
+				auto arc = parseArc(current_, p, to);
+				auto steps = std::clamp(
+					flattenedPointCount(arc, fs_.arcTolerance, transform_),
+					fs_.minArcSteps, fs_.maxArcSteps);
+				out_.arc(arc, steps, t(to), transform_);
+			}
+			lastControlC_ = lastControlQ_ = to;
+		} else {
+			static_assert(!std::is_same_v<P, P>, "Invalid segment params");
+		}
+
+		current_ = to;
+	}
+
+protected:
+	Vec2f t(Vec2f p) const { return apply(transform_, p); }
+
+protected:
+	const FlattenSettings& fs_;
+	const Transform& transform_;
+	Out& out_;
+
+	Vec2f start_ {};
+	Vec2f current_ {};
+	Vec2f lastControlQ_ {};
+	Vec2f lastControlC_ {};
+};
+
+/// Implements flatten(const Path&, FlattenedPath&, ...) for all path
+/// representations: count(i) and write(i, span) are called for the
+/// subpaths [0, count).
+template<typename CountFn, typename WriteFn>
+void flattenSubpaths(unsigned count, FlattenedPath& out,
+		const ParallelForFn& parallelFor, CountFn&& countFn,
+		WriteFn&& writeFn) {
+	auto forEach = [&](const std::function<void(unsigned)>& job) {
+		if(parallelFor) {
+			parallelFor(count, job);
+		} else {
+			for(auto i = 0u; i < count; ++i) {
+				job(i);
+			}
+		}
+	};
+
+	out.offsets.resize(count + 1);
+	out.offsets[0] = 0u;
+	forEach([&](unsigned i) {
+		out.offsets[i + 1] = countFn(i);
+	});
+
+	for(auto i = 0u; i < count; ++i) {
+		out.offsets[i + 1] += out.offsets[i];
+	}
+
+	out.points.resize(out.offsets.back());
+	forEach([&](unsigned i) {
+		auto offset = out.offsets[i];
+		auto size = out.offsets[i + 1] - offset;
+		writeFn(i, Span<Vec2f>(out.points.data() + offset, size));
+	});
+}
+
+} // namespace ktc::detail
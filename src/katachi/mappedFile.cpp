@@ -0,0 +1,95 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <katachi/mappedFile.hpp>
+#include <dlg/dlg.hpp>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#define KTC_MMAP
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace ktc {
+
+MappedFile::MappedFile(const char* filename) {
+	dlg_assert(filename);
+
+#ifdef KTC_MMAP
+	auto fd = ::open(filename, O_RDONLY);
+	if(fd < 0) {
+		throw std::runtime_error(std::string("Can't open file ") + filename);
+	}
+
+	struct stat st;
+	if(::fstat(fd, &st) != 0) {
+		::close(fd);
+		throw std::runtime_error(std::string("Can't stat file ") + filename);
+	}
+
+	size_ = std::size_t(st.st_size);
+	if(size_ > 0) {
+		auto ptr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(ptr == MAP_FAILED) {
+			::close(fd);
+			throw std::runtime_error(std::string("Can't map file ") + filename);
+		}
+
+		::madvise(ptr, size_, MADV_SEQUENTIAL);
+		data_ = static_cast<const char*>(ptr);
+		mapped_ = true;
+	}
+
+	::close(fd);
+#else
+	auto file = std::fopen(filename, "rb");
+	if(!file) {
+		throw std::runtime_error(std::string("Can't open file ") + filename);
+	}
+
+	std::fseek(file, 0, SEEK_END);
+	size_ = std::size_t(std::ftell(file));
+	std::fseek(file, 0, SEEK_SET);
+
+	auto buf = new char[size_ ? size_ : 1];
+	auto read = std::fread(buf, 1, size_, file);
+	std::fclose(file);
+	if(read != size_) {
+		delete[] buf;
+		throw std::runtime_error(std::string("Can't read file ") + filename);
+	}
+
+	data_ = buf;
+#endif
+}
+
+MappedFile::~MappedFile() {
+	if(!data_) {
+		return;
+	}
+
+#ifdef KTC_MMAP
+	if(mapped_) {
+		::munmap(const_cast<char*>(data_), size_);
+		return;
+	}
+#endif
+
+	delete[] data_;
+}
+
+void swap(MappedFile& a, MappedFile& b) noexcept {
+	using std::swap;
+	swap(a.data_, b.data_);
+	swap(a.size_, b.size_);
+	swap(a.mapped_, b.mapped_);
+}
+
+} // namespace ktc
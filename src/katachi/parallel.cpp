@@ -0,0 +1,112 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include <katachi/parallel.hpp>
+#include <dlg/dlg.hpp>
+#include <algorithm>
+
+namespace ktc {
+namespace {
+
+// The pool whose jobs the calling thread is executing, if any.
+thread_local const ThreadPool* runningPool {};
+
+} // anon namespace
+
+ThreadPool::ThreadPool(unsigned threads) {
+	if(threads == 0u) {
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	workers_.reserve(threads - 1);
+	for(auto i = 1u; i < threads; ++i) {
+		workers_.emplace_back([this]{ work(); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(mutex_);
+		exit_ = true;
+	}
+
+	cv_.notify_all();
+	for(auto& worker : workers_) {
+		worker.join();
+	}
+}
+
+void ThreadPool::runJobs() {
+	// jobs must not throw, so this is always restored
+	auto prev = runningPool;
+	runningPool = this;
+
+	unsigned i;
+	while((i = next_.fetch_add(1u, std::memory_order_relaxed)) < count_) {
+		(*job_)(i);
+	}
+
+	runningPool = prev;
+}
+
+void ThreadPool::work() {
+	std::uint64_t generation = 0u;
+	while(true) {
+		{
+			std::unique_lock lock(mutex_);
+			cv_.wait(lock, [&]{ return exit_ || generation_ != generation; });
+			if(exit_) {
+				return;
+			}
+
+			generation = generation_;
+		}
+
+		runJobs();
+
+		std::lock_guard lock(mutex_);
+		if(--active_ == 0u) {
+			doneCv_.notify_one();
+		}
+	}
+}
+
+void ThreadPool::parallelFor(unsigned count,
+		const std::function<void(unsigned)>& job) {
+	dlg_assert(job);
+
+	// Nested calls from a job of this pool would wait for the call
+	// they are part of, run them serially on the calling thread
+	if(workers_.empty() || count <= 1u || runningPool == this) {
+		for(auto i = 0u; i < count; ++i) {
+			job(i);
+		}
+		return;
+	}
+
+	std::lock_guard callLock(callMutex_);
+	{
+		std::lock_guard lock(mutex_);
+		job_ = &job;
+		count_ = count;
+		next_.store(0u, std::memory_order_relaxed);
+		active_ = unsigned(workers_.size());
+		++generation_;
+	}
+
+	cv_.notify_all();
+	runJobs();
+
+	std::unique_lock lock(mutex_);
+	doneCv_.wait(lock, [&]{ return active_ == 0u; });
+	job_ = nullptr;
+}
+
+ParallelForFn ThreadPool::executor() {
+	return [this](unsigned count, const std::function<void(unsigned)>& job) {
+		parallelFor(count, job);
+	};
+}
+
+} // namespace ktc
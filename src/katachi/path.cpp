@@ -2,16 +2,42 @@
 // Distributed under the Boost Software License, Version 1.0.
 // See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
 
+#include "flattener.hpp"
 #include <katachi/path.hpp>
 #include <katachi/curves.hpp>
 #include <nytl/math.hpp>
 #include <nytl/vecOps.hpp>
 #include <dlg/dlg.hpp>
+#include <algorithm>
 #include <cmath>
 
 // https://www.w3.org/TR/SVG11/paths.html#PathElement
 
 namespace ktc {
+namespace {
+
+using detail::CountOutput;
+using detail::SpanOutput;
+using detail::VectorOutput;
+
+/// Flattens the given subpath into the given output.
+template<typename Out>
+void flatten(const Subpath& sub, const FlattenSettings& fs,
+		const Transform& transform, Out& out) {
+	if(sub.commands.empty()) {
+		return;
+	}
+
+	detail::Flattener<Out> flattener(fs, transform, out);
+	flattener.start(sub.start);
+	for(auto& cmd : sub.commands) {
+		visit([&](auto& p) { flattener.segment(cmd.to, p); }, cmd.params);
+	}
+
+	flattener.finish(sub.closed);
+}
+
+} // anon namespace
 
 // Subpath
 Command& Subpath::line(Vec2f to) {
@@ -46,81 +72,65 @@ Command& Subpath::scBezier(Vec2f to, const SCBezierParams& bezier) {
 
 // Path
 Subpath& Path::move(Vec2f to) {
-	subpaths.push_back({to});
+	subpaths.emplace_back(to);
 	return subpaths.back();
 }
 
-std::vector<Vec2f> flatten(const Subpath& sub, const FlattenSettings& fs) {
-	if(sub.commands.empty()) {
-		return {};
-	}
+CenterArc parseArc(Vec2f from, const ArcParams& params, Vec2f to) {
+	return endToCenter({from, to, params.radius, params.largeArc,
+		params.clockwise, params.rotation});
+}
 
-	std::vector<Vec2f> points = {sub.start};
-	points.reserve(sub.commands.size() * 2);
-
-	auto current = sub.start;
-	auto lastControlQ = current;
-	auto lastControlC = current;
-	auto to = current;
-
-	auto commandBaker = [&](auto&& p){
-		using T = std::decay_t<decltype(p)>;
-
-		if constexpr(std::is_same_v<T, LineParams>) {
-			points.push_back(to);
-			lastControlC = lastControlQ = to;
-		} else if constexpr(std::is_same_v<T, QBezierParams>) {
-			auto b = QuadBezier {current, p.control, to};
-			flatten(b, points, fs.maxQBezLevel, fs.minQBezDist);
-			lastControlQ = p.control;
-			lastControlC = to;
-		} else if constexpr(std::is_same_v<T, SQBezierParams>) {
-			lastControlQ = mirror(current, lastControlQ);
-			auto b = QuadBezier {current, lastControlQ, to};
-			flatten(b, points, fs.maxQBezLevel, fs.minQBezDist);
-			lastControlC = to;
-		} else if constexpr(std::is_same_v<T, CBezierParams>) {
-			auto b = CubicBezier {current, p.control1, p.control2, to};
-			flatten(b, points, fs.maxCBezLevel, fs.minCBezDist);
-			lastControlQ = to;
-			lastControlC = p.control2;
-		} else if constexpr(std::is_same_v<T, SCBezierParams>) {
-			auto control = mirror(current, lastControlC);
-			auto b = CubicBezier {current, control, p.control2, to};
-			flatten(b, points, fs.maxCBezLevel, fs.minCBezDist);
-			lastControlQ = to;
-			lastControlC = p.control2;
-		} else if constexpr(std::is_same_v<T, ArcParams>) {
-			// if radius is {0.f, 0.f} draw a straight line
-			if(p.radius == Vec {0.f, 0.f}) {
-				points.push_back(to);
-			} else {
-				auto arc = endToCenter({current, to, p.radius,
-					p.largeArc, p.clockwise});
-				auto fac = std::abs(arc.end - arc.start) * length(arc.radius);
-				auto steps = std::clamp<unsigned>(fs.arcLengthFac * fac,
-					fs.minArcSteps, fs.maxArcSteps);
-				flatten(arc, points, steps);
-			}
-			lastControlC = lastControlQ = to;
-		} else {
-			dlg_error("bake(Subpath): Invalid variant");
-			return;
-		}
-	};
+unsigned flattenedPointCount(const Subpath& sub, const FlattenSettings& fs,
+		const Transform& transform) {
+	CountOutput out;
+	flatten(sub, fs, transform, out);
+	return out.count;
+}
 
-	for(auto& cmd : sub.commands) {
-		to = cmd.to;
-		visit(commandBaker, cmd.params);
-		current = to;
-	}
+unsigned flatten(const Subpath& sub, Span<Vec2f> points,
+		const FlattenSettings& fs, const Transform& transform) {
+	SpanOutput out {points};
+	flatten(sub, fs, transform, out);
+	return out.count;
+}
 
-	if(sub.closed) {
-		points.push_back(sub.start);
-	}
+void flatten(const Subpath& sub, std::vector<Vec2f>& points,
+		const FlattenSettings& fs, const Transform& transform) {
+	VectorOutput<> out {points};
+	flatten(sub, fs, transform, out);
+}
 
+void flatten(const Subpath& sub, std::pmr::vector<Vec2f>& points,
+		const FlattenSettings& fs, const Transform& transform) {
+	VectorOutput<std::pmr::vector<Vec2f>> out {points};
+	flatten(sub, fs, transform, out);
+}
+
+std::vector<Vec2f> flatten(const Subpath& sub, const FlattenSettings& fs,
+		const Transform& transform) {
+	std::vector<Vec2f> points;
+	points.reserve(flattenedPointCount(sub, fs, transform));
+	flatten(sub, points, fs, transform);
 	return points;
 }
 
+void flatten(const Path& path, FlattenedPath& out, const FlattenSettings& fs,
+		const Transform& transform, const ParallelForFn& parallelFor) {
+	auto& subs = path.subpaths;
+	detail::flattenSubpaths(unsigned(subs.size()), out, parallelFor,
+		[&](unsigned i) { return flattenedPointCount(subs[i], fs, transform); },
+		[&](unsigned i, Span<Vec2f> points) {
+			flatten(subs[i], points, fs, transform);
+		});
+}
+
+FlattenedPath flatten(const Path& path, const FlattenSettings& fs,
+		const Transform& transform, const ParallelForFn& parallelFor) {
+	FlattenedPath ret;
+	flatten(path, ret, fs, transform, parallelFor);
+	return ret;
+}
+
 } // namespace ktc
 
@@ -0,0 +1,61 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+// Internal header, recording of stats (stats.hpp).
+// KTC_STAT(expr) applies expr to the Stats of the calling thread,
+// e.g. KTC_STAT(strokeVertices += 2). Without KTC_STATS it expands to
+// nothing, the arguments are not evaluated.
+
+#pragma once
+
+#include <katachi/stats.hpp>
+
+#ifdef KTC_STATS
+	#define KTC_STAT(expr) (::ktc::detail::stats.expr)
+#else
+	#define KTC_STAT(expr) ((void) 0)
+#endif
+
+namespace ktc::detail {
+
+#ifdef KTC_STATS
+inline thread_local Stats stats {};
+
+/// Records a curve flattened into the given number of segments.
+inline void recordSegments(Stats::Histogram& histogram, unsigned count) {
+	auto bucket = 0u;
+	for(; count > 1u && bucket + 1 < Stats::histogramSize; count >>= 1) {
+		++bucket;
+	}
+
+	++histogram[bucket];
+}
+#endif
+
+/// Record a curve that was flattened into the given number of points.
+inline void record([[maybe_unused]] const QuadBezier& curve,
+		[[maybe_unused]] unsigned points) {
+#ifdef KTC_STATS
+	stats.quadPoints += points;
+	recordSegments(stats.quadSegments, points);
+#endif
+}
+
+inline void record([[maybe_unused]] const CubicBezier& curve,
+		[[maybe_unused]] unsigned points) {
+#ifdef KTC_STATS
+	stats.cubicPoints += points;
+	recordSegments(stats.cubicSegments, points);
+#endif
+}
+
+inline void record([[maybe_unused]] const CenterArc& arc,
+		[[maybe_unused]] unsigned points) {
+#ifdef KTC_STATS
+	stats.arcPoints += points;
+	recordSegments(stats.arcSteps, points);
+#endif
+}
+
+} // namespace ktc::detail
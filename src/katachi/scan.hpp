@@ -0,0 +1,58 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+// Internal header, char scanning helpers shared by the svg path parser
+// and the svg document loader.
+// Defines KTC_SIMD_SSE2 when SSE2 intrinsics are available.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#define KTC_SIMD_SSE2
+	#include <emmintrin.h>
+#endif
+
+namespace ktc::detail {
+
+// Whitespace as defined by the svg grammar, independent from the locale.
+inline bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+/// Returns the number of trailing zero bits. Mask must not be zero.
+inline unsigned countTrailingZeros(std::uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+	return unsigned(__builtin_ctzll(mask));
+#else
+	auto count = 0u;
+	for(; !(mask & 1u); mask >>= 1) {
+		++count;
+	}
+	return count;
+#endif
+}
+
+/// Returns the first occurrence of c in [it, end) or end.
+/// Checks 16 bytes at once using SSE2 where available.
+inline const char* find(const char* it, const char* end, char c) {
+#ifdef KTC_SIMD_SSE2
+	auto pattern = _mm_set1_epi8(c);
+	for(; end - it >= 16; it += 16) {
+		auto chunk = _mm_loadu_si128(static_cast<const __m128i*>(
+			static_cast<const void*>(it)));
+		auto mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pattern));
+		if(mask) {
+			return it + countTrailingZeros(unsigned(mask));
+		}
+	}
+#endif
+
+	auto res = std::memchr(it, c, std::size_t(end - it));
+	return res ? static_cast<const char*>(res) : end;
+}
+
+} // namespace ktc::detail
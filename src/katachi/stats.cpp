@@ -0,0 +1,66 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include "record.hpp"
+#include <katachi/stats.hpp>
+#include <katachi/stroke.hpp>
+
+namespace ktc {
+
+bool statsEnabled() {
+#ifdef KTC_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+const Stats& threadStats() {
+#ifdef KTC_STATS
+	return detail::stats;
+#else
+	static const Stats empty {};
+	return empty;
+#endif
+}
+
+void resetThreadStats() {
+#ifdef KTC_STATS
+	detail::stats = {};
+#endif
+}
+
+Stats& operator+=(Stats& a, const Stats& b) {
+	for(auto i = 0u; i < Stats::histogramSize; ++i) {
+		a.quadSegments[i] += b.quadSegments[i];
+		a.cubicSegments[i] += b.cubicSegments[i];
+		a.arcSteps[i] += b.arcSteps[i];
+	}
+
+	a.linePoints += b.linePoints;
+	a.quadPoints += b.quadPoints;
+	a.cubicPoints += b.cubicPoints;
+	a.arcPoints += b.arcPoints;
+	a.degeneratePoints += b.degeneratePoints;
+	a.strokeVertices += b.strokeVertices;
+	a.fillVertices += b.fillVertices;
+	return a;
+}
+
+#ifdef KTC_STATS
+namespace detail {
+
+void recordStroke(unsigned vertices, unsigned degenerate) {
+	KTC_STAT(strokeVertices += vertices);
+	KTC_STAT(degeneratePoints += degenerate);
+}
+
+void recordFill(unsigned vertices, unsigned degenerate) {
+	KTC_STAT(fillVertices += vertices);
+	KTC_STAT(degeneratePoints += degenerate);
+}
+
+} // namespace detail
+#endif
+} // namespace ktc
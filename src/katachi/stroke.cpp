@@ -2,6 +2,7 @@
 // Distributed under the Boost Software License, Version 1.0.
 // See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
 
+#include "record.hpp"
 #include <katachi/stroke.hpp>
 #include <katachi/path.hpp>
 #include <nytl/vecOps.hpp>
@@ -14,142 +15,29 @@
 
 namespace ktc {
 
-/// Returns the left normal of a 2 dimensional vector.
-template<typename T>
-Vec2<T> lnormal(Vec2<T> vec) {
-	return {-vec[1], vec[0]};
-}
+using detail::rnormal;
 
-/// Returns the right normal of a 2 dimensional vector.
-template<typename T>
-Vec2<T> rnormal(Vec2<T> vec) {
-	return {vec[1], -vec[0]};
-}
+namespace {
 
-void bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
-		Span<const Vec4u8> color, const VertexHandlerFn& handler) {
-
-	dlg_assert(settings.width > 0.f);
-	dlg_assert(handler);
+/// Vertex handler writing into a span that is large enough.
+struct SpanWriter {
+	Span<Vertex> out;
+	unsigned count {};
 
-	if(points.size() < 2) {
-		return;
-	}
-
-	auto iwidth = settings.width * (0.5f + 0.5f * settings.extrude);
-	auto owidth = settings.width * (0.5f - 0.5f * settings.extrude);
-	iwidth += 0.5 * settings.fringe; // half extrude, half inside
-	owidth += 0.5 * settings.fringe; // half extrude, half inside
-
-	// we will in the following assume that the points are ordered
-	// counter-clockwise
-	if(area(points) < 0.0) {
-		std::swap(iwidth, owidth);
-		iwidth *= -1;
-		owidth *= -1;
+	void operator()(const Vertex& vertex) {
+		dlg_assert(count < out.size());
+		out[count++] = vertex;
 	}
+};
 
-	auto p0 = points.back();
-	auto p1 = points.front();
-	auto p2 = points[1];
-
-	// start cap
-	auto start = 0u;
-	auto end = points.size() + settings.loop;
-	auto capFringe = settings.capFringe * 0.5f;
-	if(!settings.loop && capFringe > 0.f) {
-		start = 1u;
-		end = points.size() - 1;
-
-		auto xextrusion = normalized(p2 - p1);
-		auto yextrusion = rnormal(xextrusion);
-		auto c = color.size() > 0 ? color[0] : Vec4u8{0, 0, 0, 255};
-		handler({
-			p1 - capFringe * xextrusion + owidth * yextrusion,
-			{0.f, 1.f}, c
-		});
-		handler({
-			p1 - capFringe * xextrusion - iwidth * yextrusion,
-			{0.f, -1.f}, c
-		});
-
-		handler({
-			p1 + capFringe * xextrusion + owidth * yextrusion,
-			{1.f, 1.f}, c
-		});
-		handler({
-			p1 + capFringe * xextrusion - iwidth * yextrusion,
-			{1.f, -1.f}, c
-		});
-
-		p0 = p1;
-		p1 = p2;
-		p2 = points[2 % points.size()];
-
-	}
-
-	for(auto i = start; i < end; ++i) {
-		auto d0 = rnormal(p1 - p0);
-		auto d1 = rnormal(p2 - p1);
-
-		if(i == 0 && !settings.loop) {
-			d0 = d1;
-		} else if(i == points.size() - 1 && !settings.loop) {
-			d1 = d0;
-		}
-
-		// skip point if same to next or previous one
-		// this assures normalized below will not throw (for nullvector)
-		if(d0 == approx(Vec{0.f, 0.f}) || d1 == approx(Vec{0.f, 0.f})) {
-			dlg_debug("ktc::bakeStroke: doubled point {}", p1);
-			p1 = p2;
-			p2 = points[i + 2 % points.size()];
-			continue;
-		}
-
-		auto extrusion = 0.5f * (normalized(d0) + normalized(d1));
-		extrusion *= 1.f / dot(extrusion, extrusion);
-
-		handler({
-			p1 + owidth * extrusion,
-			{1.f, 1.f},
-			color.size() > i ? color[i] : Vec4u8{0, 0, 0, 255}
-		});
-		handler({
-			p1 - iwidth * extrusion,
-			{1.f, -1.f},
-			color.size() > i ? color[i] : Vec4u8{0, 0, 0, 255}
-		});
+} // anon namespace
 
-		p0 = points[(i + 0) % points.size()];
-		p1 = points[(i + 1) % points.size()];
-		p2 = points[(i + 2) % points.size()];
-	}
-
-	// end cap
-	if(!settings.loop && settings.capFringe > 0.f) {
-		auto i = points.size() - 1;
-		auto c = color.size() > i ? color[i] : Vec4u8{0, 0, 0, 255};
-		auto xextrusion = normalized(p1 - p0);
-		auto yextrusion = rnormal(xextrusion);
-		handler({
-			p1 - capFringe * xextrusion + owidth * yextrusion,
-			{1.f, 1.f}, c
-		});
-		handler({
-			p1 - capFringe * xextrusion - iwidth * yextrusion,
-			{1.f, -1.f}, c
-		});
-
-		handler({
-			p1 + capFringe * xextrusion + owidth * yextrusion,
-			{0.f, 1.f}, c
-		});
-		handler({
-			p1 + capFringe * xextrusion - iwidth * yextrusion,
-			{0.f, -1.f}, c
-		});
-	}
+void bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+		Span<const Vec4u8> color, const VertexHandlerFn& handler) {
+	dlg_assert(settings.width > 0.f);
+	dlg_assert(settings.roundTolerance > 0.f);
+	dlg_assert(handler);
+	detail::bakeStroke(points, settings, color, handler);
 }
 
 void bakeFillAA(Span<const Vec2f> points, Span<const Vec4u8> color,
@@ -158,71 +46,7 @@ void bakeFillAA(Span<const Vec2f> points, Span<const Vec4u8> color,
 	dlg_assert(fringe > 0.f);
 	dlg_assert(fill);
 	dlg_assert(stroke);
-
-	if(points.size() < 2) {
-		return;
-	}
-
-	auto loop = points.front() == points.back();
-	if(loop) {
-		points = points.first(points.size() - 1);
-	}
-
-	fringe *= 0.5f;
-	if(area(points) < 0.0) {
-		fringe *= -1;
-	}
-
-	auto p0 = points.back();
-	auto p1 = points.front();
-	auto p2 = points[1];
-
-	for(auto i = 0u; i < points.size() + loop; ++i) {
-		auto d0 = rnormal(p1 - p0);
-		auto d1 = rnormal(p2 - p1);
-
-		if(i == 0 && !loop) {
-			d0 = d1;
-		} else if(i == points.size() - 1 && !loop) {
-			d1 = d0;
-		}
-
-		// skip point if same to next or previous one
-		// this assures normalized below will not throw (for nullvector)
-		if(d0 == approx(Vec {0.f, 0.f}) || d1 == approx(Vec {0.f, 0.f})) {
-			dlg_debug("ktc::bakeFillAA: doubled point {}", p1);
-			p1 = p2;
-			p2 = points[i + 2 % points.size()];
-			continue;
-		}
-
-		// fill
-		auto extrusion = 0.5f * (normalized(d0) + normalized(d1));
-		extrusion *= 1.f / dot(extrusion, extrusion);
-
-		fill({
-			p1 - fringe * extrusion,
-			{1.f, 0.f},
-			color.size() > i ? color[i] : Vec4u8{0, 0, 0, 255}
-		});
-
-		// stroke
-		stroke({
-			p1 - fringe * extrusion,
-			{1.f, 0.f},
-			color.size() > i ? color[i] : Vec4u8{0, 0, 0, 255}
-		});
-
-		stroke({
-			p1 + fringe * extrusion,
-			{1.f, 1.f},
-			color.size() > i ? color[i] : Vec4u8{0, 0, 0, 255}
-		});
-
-		p0 = points[(i + 0) % points.size()];
-		p1 = points[(i + 1) % points.size()];
-		p2 = points[(i + 2) % points.size()];
-	}
+	detail::bakeFillAA(points, color, fringe, fill, stroke);
 }
 
 void bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
@@ -248,6 +72,55 @@ void bakeColoredFillAA(Span<const Vec2f> points, Span<const Vec4u8> color,
 	bakeFillAA(points, color, fringe, fill, stroke);
 }
 
+unsigned strokeVertexCount(Span<const Vec2f> points,
+		const StrokeSettings& settings) {
+	detail::CountHandler counter;
+	detail::bakeStroke(points, settings, {}, counter);
+	return counter.count;
+}
+
+unsigned dashedStrokeVertexCount(Span<const Vec2f> points,
+		const StrokeSettings& settings, const DashPattern& dash) {
+	detail::CountHandler counter;
+	detail::bakeDashedStroke(points, settings, dash, {}, counter,
+		std::pmr::get_default_resource());
+	return counter.count;
+}
+
+unsigned bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+		Span<Vertex> out) {
+	return bakeStroke(points, settings, {}, out);
+}
+
+unsigned bakeStroke(Span<const Vec2f> points, const StrokeSettings& settings,
+		Span<const Vec4u8> color, Span<Vertex> out) {
+	dlg_assert(settings.width > 0.f);
+	dlg_assert(settings.roundTolerance > 0.f);
+	SpanWriter writer {out};
+	detail::bakeStroke(points, settings, color, writer);
+	return writer.count;
+}
+
+FillAACount fillAAVertexCount(Span<const Vec2f> points) {
+	detail::CountHandler fill, stroke;
+	detail::bakeFillAA(points, {}, 1.f, fill, stroke);
+	return {fill.count, stroke.count};
+}
+
+FillAACount bakeFillAA(Span<const Vec2f> points, float fringe,
+		Span<Vertex> fill, Span<Vertex> stroke) {
+	return bakeFillAA(points, {}, fringe, fill, stroke);
+}
+
+FillAACount bakeFillAA(Span<const Vec2f> points, Span<const Vec4u8> color,
+		float fringe, Span<Vertex> fill, Span<Vertex> stroke) {
+	dlg_assert(fringe > 0.f);
+	SpanWriter fillWriter {fill};
+	SpanWriter strokeWriter {stroke};
+	detail::bakeFillAA(points, color, fringe, fillWriter, strokeWriter);
+	return {fillWriter.count, strokeWriter.count};
+}
+
 float area(Span<const Vec2f> points) {
 	float ret = 0.f;
 	for(auto i = 2u; i < points.size(); ++i) {
@@ -334,12 +207,15 @@ template std::vector<u16> triangleStripIndices<u16>(unsigned count);
 template std::vector<u32> triangleStripIndices<u32>(unsigned count);
 template std::vector<u64> triangleStripIndices<u64>(unsigned count);
 
-CombinedFill bakeCombinedFillAA(Span<const Vec2f> points,
-		Span<const Vec4u8> color, float fringe) {
-	dlg_assert(fringe > 0.f);
+namespace {
 
+/// Implements the bakeCombinedFillAA variants, calls vertex(Vertex)
+/// and index(unsigned) for the output.
+template<typename VH, typename IH>
+void bakeCombined(Span<const Vec2f> points, Span<const Vec4u8> color,
+		float fringe, VH& vertex, IH& index) {
 	if(points.size() < 2) {
-		return {};
+		return;
 	}
 
 	auto loop = true; // points.front() == points.back(); // TODO
@@ -356,7 +232,9 @@ CombinedFill bakeCombinedFillAA(Span<const Vec2f> points,
 	auto p1 = points.front();
 	auto p2 = points[1];
 
-	CombinedFill ret;
+	// number of points with output, the vertices of point j are
+	// 2 * j (fill) and 2 * j + 1 (stroke)
+	auto j = 0u;
 	for(auto i = 0u; i < points.size() + loop; ++i) {
 		auto d0 = rnormal(p1 - p0);
 		auto d1 = rnormal(p2 - p1);
@@ -370,9 +248,11 @@ CombinedFill bakeCombinedFillAA(Span<const Vec2f> points,
 		// skip point if same to next or previous one
 		// this assures normalized below will not throw (for nullvector)
 		if(d0 == approx(Vec {0.f, 0.f}) || d1 == approx(Vec {0.f, 0.f})) {
-			dlg_debug("ktc::bakeFillAA: doubled point {}", p1);
+			if constexpr(!std::is_same_v<VH, detail::CountHandler>) {
+				KTC_STAT(degeneratePoints++);
+			}
 			p1 = p2;
-			p2 = points[i + 2 % points.size()];
+			p2 = points[(i + 2) % points.size()];
 			continue;
 		}
 
@@ -380,43 +260,83 @@ CombinedFill bakeCombinedFillAA(Span<const Vec2f> points,
 		auto extrusion = 0.5f * (normalized(d0) + normalized(d1));
 		extrusion *= 1.f / dot(extrusion, extrusion);
 
-		ret.vertices.push_back({
-			p1 - fringe * extrusion,
-			{1.f, 0.f},
-			color.size() > i ? color[i] : Vec4u8{0, 0, 0, 255}
-		});
+		auto c = color.size() > i ? color[i] : Vec4u8{0, 0, 0, 255};
+		vertex(Vertex{p1 - fringe * extrusion, {1.f, 0.f}, c});
 
-		if(i >= 2) {
+		if(j >= 2) {
 			// triangle fan
-			ret.indices.push_back(0); // first fill vertex
-			ret.indices.push_back(2 * i - 2); // previous fill vertex
-			ret.indices.push_back(2 * i); // current fill vertex
+			index(0u); // first fill vertex
+			index(2 * j - 2); // previous fill vertex
+			index(2 * j); // current fill vertex
 		}
 
 		// stroke
-		ret.vertices.push_back({
-			p1 + fringe * extrusion,
-			{1.f, 1.f},
-			color.size() > i ? color[i] : Vec4u8{0, 0, 0, 255}
-		});
+		vertex(Vertex{p1 + fringe * extrusion, {1.f, 1.f}, c});
 
-		if(i >= 1) {
+		if(j >= 1) {
 			// triangle strip, we need 2 triangles for one stroke segment
-			ret.indices.push_back(2 * i - 2); // previous fill vertex
-			ret.indices.push_back(2 * i - 1); // previous stroke vertex
-			ret.indices.push_back(2 * i + 0); // current fill vertex
+			index(2 * j - 2); // previous fill vertex
+			index(2 * j - 1); // previous stroke vertex
+			index(2 * j + 0); // current fill vertex
 
-			ret.indices.push_back(2 * i - 1); // previous stroke vertex
-			ret.indices.push_back(2 * i + 1); // current stroke vertex
-			ret.indices.push_back(2 * i + 0); // current fill vertex
+			index(2 * j - 1); // previous stroke vertex
+			index(2 * j + 1); // current stroke vertex
+			index(2 * j + 0); // current fill vertex
 		}
 
+		++j;
 		p0 = points[(i + 0) % points.size()];
 		p1 = points[(i + 1) % points.size()];
 		p2 = points[(i + 2) % points.size()];
 	}
 
+	if constexpr(!std::is_same_v<VH, detail::CountHandler>) {
+		KTC_STAT(fillVertices += 2 * j);
+	}
+}
+
+} // anon namespace
+
+CombinedFill bakeCombinedFillAA(Span<const Vec2f> points,
+		Span<const Vec4u8> color, float fringe,
+		std::pmr::memory_resource* memory) {
+	dlg_assert(fringe > 0.f);
+
+	// reserve for the case without skipped points, which is an upper
+	// bound and exact for most inputs
+	CombinedFill ret(memory);
+	if(points.size() >= 2) {
+		auto n = points.size() + 1;
+		ret.vertices.reserve(2 * n);
+		ret.indices.reserve(9 * n - 12);
+	}
+
+	auto vertex = [&](const Vertex& v) { ret.vertices.push_back(v); };
+	auto index = [&](unsigned i) { ret.indices.push_back(i); };
+	bakeCombined(points, color, fringe, vertex, index);
 	return ret;
 }
 
+CombinedFillCount combinedFillAACount(Span<const Vec2f> points) {
+	detail::CountHandler vertices, indices;
+	bakeCombined(points, {}, 1.f, vertices, indices);
+	return {vertices.count, indices.count};
+}
+
+CombinedFillCount bakeCombinedFillAA(Span<const Vec2f> points,
+		Span<const Vec4u8> color, float fringe, Span<Vertex> vertices,
+		Span<unsigned> indices, unsigned baseVertex) {
+	dlg_assert(fringe > 0.f);
+
+	SpanWriter vertex {vertices};
+	auto count = 0u;
+	auto index = [&](unsigned i) {
+		dlg_assert(count < indices.size());
+		indices[count++] = baseVertex + i;
+	};
+
+	bakeCombined(points, color, fringe, vertex, index);
+	return {vertex.count, count};
+}
+
 } // namespace ktc
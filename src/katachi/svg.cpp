@@ -2,270 +2,704 @@
 // Distributed under the Boost Software License, Version 1.0.
 // See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
 
+#include "flattener.hpp"
+#include "scan.hpp"
 #include <katachi/svg.hpp>
 #include <katachi/path.hpp>
+#include <nytl/math.hpp>
+#include <nytl/vecOps.hpp>
 #include <dlg/dlg.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || \
+		defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64)
+	#define KTC_LITTLE_ENDIAN
+#endif
 
 namespace ktc {
 namespace {
 
-Path parseSvgPath(StringParam svgSubpath,
-		std::optional<SvgError>& error, Vec2f start, Subpath* sub) {
-
-	// TODO: error checks etc
-	//  - check for nonnegative numbers (e.g. radius), flags
-	//  - handle arc axis rotation
+using detail::isSpace;
+using detail::countTrailingZeros;
 
-	//  NOTE: probably better as clean recursive descent parser
+// Exactly representable powers of ten
+constexpr double exactPow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
 
-	error.reset();
+bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
 
-	Path ret;
-	Subpath* current = sub;
-	if(!current) {
-		ret.subpaths.push_back({start});
-		current = &ret.subpaths.back();
-	} else {
-		sub->start = start;
+bool isCommand(char c) {
+	switch(c) {
+		case 'M': case 'm': case 'L': case 'l': case 'H': case 'h':
+		case 'V': case 'v': case 'C': case 'c': case 'S': case 's':
+		case 'Q': case 'q': case 'T': case 't': case 'A': case 'a':
+		case 'Z': case 'z':
+			return true;
+		default:
+			return false;
 	}
+}
 
-	auto begin = svgSubpath.c_str();
-	auto it = begin;
-	dlg_assert(it);
+// Chars that may appear in a number. Used to detect whether a number
+// at the end of a chunk might be continued in the next one.
+bool isNumberChar(char c) {
+	return isDigit(c) || c == '.' || c == '-' || c == '+' ||
+		c == 'e' || c == 'E';
+}
 
-	auto skipSpace = [&] {
-		while(isspace(*it)) {
-			++it;
+constexpr auto blockSize = 64u;
+
+/// Returns a mask with a bit set for each whitespace char in the given
+/// block of at most blockSize chars. Whole blocks are classified 16
+/// chars at once using SSE2 where available.
+std::uint64_t spaceMask(const char* block, unsigned size) {
+	std::uint64_t ret = 0u;
+
+#ifdef KTC_SIMD_SSE2
+	if(size == blockSize) {
+		for(auto i = 0u; i < blockSize; i += 16u) {
+			auto chars = _mm_loadu_si128(static_cast<const __m128i*>(
+				static_cast<const void*>(block + i)));
+			auto eq = [&](char c) {
+				return _mm_cmpeq_epi8(chars, _mm_set1_epi8(c));
+			};
+
+			auto space = _mm_or_si128(
+				_mm_or_si128(eq(' '), eq('\n')),
+				_mm_or_si128(_mm_or_si128(eq('\t'), eq('\r')), eq('\f')));
+			ret |= std::uint64_t(unsigned(_mm_movemask_epi8(space))) << i;
 		}
-	};
 
-	auto skipComma = [&] {
-		if(*it == ',') {
-			++it;
-		}
-	};
+		return ret;
+	}
+#endif
+
+	for(auto i = 0u; i < size; ++i) {
+		ret |= std::uint64_t(isSpace(block[i])) << i;
+	}
+
+	return ret;
+}
+
+/// Finds the ends of whitespace runs in the given data.
+/// The data is classified in blocks of blockSize chars, each turned into
+/// a mask once, so that finding the end of a longer run only needs a
+/// shift and a bit scan instead of per-char branches.
+class SpaceScanner {
+public:
+	SpaceScanner(const char* begin, const char* end) : end_(end) {
+		load(begin);
+	}
+
+	/// Returns the first char in [it, end) that is not whitespace or end.
+	const char* skip(const char* it) {
+		while(it != end_) {
+			if(std::size_t(it - block_) >= blockSize) {
+				load(it);
+			}
+
+			auto rest = ~mask_ >> unsigned(it - block_);
+			if(rest) {
+				return std::min(it + countTrailingZeros(rest), end_);
+			}
 
-	auto readFloat = [&]{
-		if(!(*it)) {
-			error = {SvgErrorType::incomplete, unsigned(it - begin)};
-			return 0.f;
+			// only reached for whole blocks
+			it = block_ + blockSize;
 		}
 
-		if(error) {
-			return 0.f;
+		return it;
+	}
+
+protected:
+	void load(const char* it) {
+		auto size = std::min<std::size_t>(blockSize, end_ - it);
+		mask_ = spaceMask(it, unsigned(size));
+		block_ = it;
+	}
+
+protected:
+	const char* end_;
+	const char* block_ {}; // start of the classified block
+	std::uint64_t mask_ {};
+};
+
+#ifdef KTC_LITTLE_ENDIAN
+constexpr std::uint64_t intPow10[] = {
+	1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u,
+};
+
+/// Returns the number of leading decimal digits in the given 8 chars,
+/// the first char being in the lowest byte.
+unsigned countDigits(std::uint64_t chars) {
+	// per byte: digits become 0-9. Adding 0x76 sets the high bit
+	// for all other values below 0x80
+	auto value = chars ^ 0x3030303030303030u;
+	auto low = value & 0x7F7F7F7F7F7F7F7Fu;
+	auto other = ((low + 0x7676767676767676u) | value) & 0x8080808080808080u;
+	return other ? countTrailingZeros(other) / 8u : 8u;
+}
+
+/// Returns the value of the first count (1 to 8) decimal digits in
+/// the given 8 chars, the first char being in the lowest byte.
+/// Converts all digits at once using SWAR multiplications.
+std::uint64_t parseDigits(std::uint64_t chars, unsigned count) {
+	// Shifting left drops the chars after the digits and adds
+	// leading zero digits
+	auto value = (chars - 0x3030303030303030u) << (8u * (8u - count));
+	value = (value * 10u + (value >> 8u)) & 0x00FF00FF00FF00FFu;
+	value = (value * 100u + (value >> 16u)) & 0x0000FFFF0000FFFFu;
+	value = (value * 10000u + (value >> 32u)) & 0xFFFFFFFFu;
+	return value;
+}
+#endif
+
+/// Appends the digits starting at it to the given mantissa and returns
+/// the end of the digits. Digits that would overflow the mantissa are
+/// dropped, exp is adjusted so that mantissa * 10^exp stays the value
+/// of the digits. For the fractional part, the added digits decrease exp.
+/// Where possible, 8 chars are classified and converted at once.
+template<bool fraction>
+const char* addDigits(const char* it, const char* end,
+		std::uint64_t& mantissa, int& exp) {
+	// significant digits that can be accumulated without overflow
+	constexpr auto mantissaLimit = (UINT64_MAX - 9) / 10;
+
+#ifdef KTC_LITTLE_ENDIAN
+	// For mantissas below this bound, adding up to 8 digits at once
+	// gives the same result as adding them one by one.
+	constexpr auto swarLimit = std::uint64_t(10000000000u);
+	while(end - it >= 8 && mantissa < swarLimit) {
+		std::uint64_t chars;
+		std::memcpy(&chars, it, 8u);
+		auto count = countDigits(chars);
+		if(count == 0u) {
+			return it;
 		}
 
-		char* e;
-		skipSpace();
-		auto r = strtof(it, &e);
-		if(it == e) {
-			error = {SvgErrorType::invalidNumber, unsigned(it - begin)};
-			return 0.f;
+		mantissa = intPow10[count] * mantissa + parseDigits(chars, count);
+		exp -= fraction ? int(count) : 0;
+		it += count;
+		if(count < 8u) {
+			return it;
+		}
+	}
+#endif
+
+	for(; it != end && isDigit(*it); ++it) {
+		if(mantissa < mantissaLimit) {
+			mantissa = 10 * mantissa + unsigned(*it - '0');
+			exp -= fraction ? 1 : 0;
+		} else if(!fraction) {
+			++exp;
 		}
+	}
+
+	return it;
+}
 
-		it = e;
-		return r;
+/// Core of the svg path parser, outputs the parsed segments to a handler.
+/// All points passed to the handler are absolute. The handler must
+/// implement the following functions:
+///  - move(Vec2f to): starts a new subpath
+///  - segment(Vec2f from, Vec2f to, const P& params): for all command
+///    param types P. Smooth curves are not resolved.
+///  - close(): closes the current subpath
+/// All state is kept in a SvgParserState so that parsing can be resumed
+/// when the input is given in chunks.
+template<typename H>
+class Parser {
+public:
+	Parser(detail::SvgParserState& state, H& handler, bool singleSubpath) :
+		state_(state), handler_(handler), singleSubpath_(singleSubpath) {}
+
+	/// Parses [begin, end). If final is false, stops before the first
+	/// command that might continue after end. Returns the end of the
+	/// consumed input. On error, sets error and stops.
+	const char* parse(const char* begin, const char* end, bool final,
+		std::optional<SvgError>& error);
+
+protected:
+	enum class Status {
+		ok,
+		error,
+		more, // incomplete input, waiting for the next chunk
 	};
 
-	auto readCoords = [&]{
-		Vec2f ret;
-		if(error) {
-			return ret;
+	void fail(SvgErrorType type) {
+		auto more = !final_ && type == SvgErrorType::incomplete;
+		status_ = more ? Status::more : Status::error;
+		error_ = {type, unsigned(state_.offset + (it_ - begin_))};
+	}
+
+	void skipSpace() {
+		// most runs are at most one char long, only use the
+		// masks for longer ones
+		if(it_ != end_ && isSpace(*it_) && ++it_ != end_ && isSpace(*it_)) {
+			it_ = space_.skip(it_);
 		}
+	}
 
-		ret.x = readFloat();
+	// skips whitespace with at most one comma
+	void skipSeparator() {
 		skipSpace();
-		skipComma();
-		skipSpace();
-		ret.y = readFloat();
-		return ret;
-	};
+		if(it_ != end_ && *it_ == ',') {
+			++it_;
+			skipSpace();
+		}
+	}
 
-	auto repeat = [&](const auto& parse) {
-		auto cmd = parse();
-		if(error) {
+	float readFloat();
+	bool readFlag();
+	Vec2f readCoords();
+
+	bool command(char c);
+
+	template<typename P>
+	bool emit(char c, Vec2f to, const P& params);
+	void beginSegment();
+
+protected:
+	detail::SvgParserState& state_;
+	H& handler_;
+	bool singleSubpath_;
+
+	const char* begin_ {};
+	const char* end_ {};
+	const char* it_ {};
+	SpaceScanner space_ {nullptr, nullptr};
+	bool final_ {};
+	Status status_ {};
+	SvgError error_ {};
+};
+
+template<typename H>
+float Parser<H>::readFloat() {
+	if(status_ != Status::ok) {
+		return 0.f;
+	}
+
+	skipSpace();
+	if(it_ == end_) {
+		fail(SvgErrorType::incomplete);
+		return 0.f;
+	}
+
+	float r;
+	auto e = scanSvgNumber(it_, end_, r);
+
+	// the number might be continued in the next chunk
+	if(!final_ && std::all_of(e, end_, isNumberChar)) {
+		status_ = Status::more;
+		return 0.f;
+	}
+
+	if(e == it_) {
+		fail(SvgErrorType::invalidNumber);
+		return 0.f;
+	}
+
+	it_ = e;
+	return r;
+}
+
+// flags are single chars and might not be separated,
+// e.g. "a1 1 0 01.5 .5"
+template<typename H>
+bool Parser<H>::readFlag() {
+	if(status_ != Status::ok) {
+		return false;
+	}
+
+	skipSpace();
+	if(it_ == end_) {
+		fail(SvgErrorType::incomplete);
+		return false;
+	}
+
+	if(*it_ != '0' && *it_ != '1') {
+		fail(SvgErrorType::invalidNumber);
+		return false;
+	}
+
+	return *(it_++) == '1';
+}
+
+template<typename H>
+Vec2f Parser<H>::readCoords() {
+	Vec2f ret;
+	ret.x = readFloat();
+	skipSeparator();
+	ret.y = readFloat();
+	return ret;
+}
+
+template<typename H>
+void Parser<H>::beginSegment() {
+	// segments without explicit move start a new subpath at the
+	// current point (either the initial start point or the end
+	// of the last subpath)
+	if(!state_.started || state_.closed) {
+		handler_.move(state_.current);
+		state_.start = state_.current;
+		state_.started = true;
+		state_.closed = false;
+	}
+}
+
+template<typename H> template<typename P>
+bool Parser<H>::emit(char c, Vec2f to, const P& params) {
+	if(status_ != Status::ok) {
+		return false;
+	}
+
+	beginSegment();
+	handler_.segment(state_.current, to, params);
+	state_.current = to;
+	state_.command = c;
+	return true;
+}
+
+/// Reads the arguments of the given command and outputs it.
+/// Returns false if that failed, status_ contains the reason then.
+template<typename H>
+bool Parser<H>::command(char c) {
+	status_ = Status::ok;
+	auto cur = state_.current;
+	auto rel = (c >= 'a' && c <= 'z') ? cur : Vec2f {0.f, 0.f};
+
+	switch(c) {
+		case 'M': case 'm': {
+			if(singleSubpath_ && state_.started) {
+				fail(SvgErrorType::subpathMove);
+				return false;
+			}
+
+			auto to = readCoords() + rel;
+			if(status_ != Status::ok) {
+				return false;
+			}
+
+			handler_.move(to);
+			state_.start = state_.current = to;
+			state_.started = true;
+			state_.closed = false;
+
+			// following coordinates are implicit line commands
+			state_.command = (c == 'M') ? 'L' : 'l';
+			return true;
+		} case 'L': case 'l': {
+			auto to = readCoords();
+			return emit(c, to + rel, LineParams {});
+		} case 'H': case 'h': {
+			auto x = readFloat();
+			return emit(c, {x + rel.x, cur.y}, LineParams {});
+		} case 'V': case 'v': {
+			auto y = readFloat();
+			return emit(c, {cur.x, y + rel.y}, LineParams {});
+		} case 'C': case 'c': {
+			CBezierParams bezier;
+			bezier.control1 = readCoords() + rel;
+			skipSeparator();
+			bezier.control2 = readCoords() + rel;
+			skipSeparator();
+			auto to = readCoords() + rel;
+			return emit(c, to, bezier);
+		} case 'S': case 's': {
+			SCBezierParams bezier;
+			bezier.control2 = readCoords() + rel;
+			skipSeparator();
+			auto to = readCoords() + rel;
+			return emit(c, to, bezier);
+		} case 'Q': case 'q': {
+			QBezierParams bezier;
+			bezier.control = readCoords() + rel;
+			skipSeparator();
+			auto to = readCoords() + rel;
+			return emit(c, to, bezier);
+		} case 'T': case 't': {
+			auto to = readCoords() + rel;
+			return emit(c, to, SQBezierParams {});
+		} case 'A': case 'a': {
+			ArcParams arc;
+			arc.radius = readCoords();
+			skipSeparator();
+			arc.rotation = readFloat() * float(nytl::constants::pi / 180);
+			skipSeparator();
+			arc.largeArc = readFlag();
+			skipSeparator();
+			arc.clockwise = readFlag();
+			skipSeparator();
+			auto to = readCoords() + rel;
+			return emit(c, to, arc);
+		} case 'Z': case 'z': {
+			beginSegment();
+			handler_.close();
+			state_.closed = true;
+
+			// the current point after closing is the start of the subpath
+			state_.current = state_.start;
+			state_.command = '\0';
+			return true;
+		} default:
+			dlg_error("Invalid svg command {}", c);
 			return false;
+	}
+}
+
+template<typename H>
+const char* Parser<H>::parse(const char* begin, const char* end, bool final,
+		std::optional<SvgError>& error) {
+	begin_ = begin;
+	end_ = end;
+	it_ = begin;
+	space_ = {begin, end};
+	final_ = final;
+
+	while(true) {
+		auto pos = it_;
+
+		// commands are implicitly repeated as long as their
+		// arguments follow
+		if(state_.command) {
+			skipSeparator();
+			if(command(state_.command)) {
+				continue;
+			} else if(status_ == Status::more) {
+				return pos;
+			}
+
+			it_ = pos;
 		}
 
-		auto itb = it;
-		while(!error) {
-			current->commands.push_back(cmd);
-			itb = it;
-			skipSpace();
-			skipComma();
-			skipSpace();
-			cmd = parse();
+		skipSpace();
+		if(it_ == end_) {
+			return it_;
 		}
 
-		error = {};
-		it = itb;
-		return true;
-	};
+		auto cpos = it_;
+		auto c = *(it_++);
+		if(!isCommand(c)) {
+			error = {SvgErrorType::invalidCommand,
+				unsigned(state_.offset + (cpos - begin_))};
+			return cpos;
+		}
 
-	bool first = true;
-	while(*it) {
-		auto last = current->start;
-		if(!current->commands.empty()) {
-			last = current->commands.back().to;
+		if(singleSubpath_ && state_.closed) {
+			error = {SvgErrorType::subpathMove,
+				unsigned(state_.offset + (cpos - begin_))};
+			return cpos;
 		}
 
-		skipSpace();
-		auto c = *it;
-		if(current->closed) {
-			if(sub) {
-				error = {SvgErrorType::subpathMove, unsigned(it - begin)};
-				return {};
-			} else if(c != 'M' && c != 'm') {
-				ret.subpaths.emplace_back();
-				ret.subpaths.back().start = last;
-				current = &ret.subpaths.back();
+		if(!command(c)) {
+			if(status_ == Status::error) {
+				error = error_;
 			}
+
+			return cpos;
+		}
+	}
+}
+
+/// Parser handler that builds a Path or a single Subpath.
+struct PathBuilder {
+	Path* path {}; // null when only a subpath is built
+	Subpath* current {};
+	bool moved {};
+
+	void move(Vec2f to) {
+		if(!moved) {
+			current->start = to;
+			moved = true;
+		} else {
+			dlg_assert(path);
+			current = &path->subpaths.emplace_back(to);
 		}
+	}
+
+	template<typename P>
+	void segment(Vec2f, Vec2f to, const P& params) {
+		current->commands.push_back({to, params});
+	}
 
+	void close() {
+		current->closed = true;
+	}
+};
+
+/// Parser handler that resolves smooth curves and forwards to a sink.
+struct SinkHandler {
+	SvgPathSink& sink;
+	detail::SvgParserState& state;
+
+	void move(Vec2f to) {
+		sink.moveTo(to);
+		state.lastControlQ = state.lastControlC = to;
+	}
+
+	void segment(Vec2f, Vec2f to, const LineParams&) {
+		sink.lineTo(to);
+		state.lastControlQ = state.lastControlC = to;
+	}
+
+	void segment(Vec2f, Vec2f to, const QBezierParams& p) {
+		sink.quadTo(p.control, to);
+		state.lastControlQ = p.control;
+		state.lastControlC = to;
+	}
+
+	void segment(Vec2f from, Vec2f to, const SQBezierParams&) {
+		auto control = mirror(from, state.lastControlQ);
+		sink.quadTo(control, to);
+		state.lastControlQ = control;
+		state.lastControlC = to;
+	}
+
+	void segment(Vec2f, Vec2f to, const CBezierParams& p) {
+		sink.cubicTo(p.control1, p.control2, to);
+		state.lastControlQ = to;
+		state.lastControlC = p.control2;
+	}
+
+	void segment(Vec2f from, Vec2f to, const SCBezierParams& p) {
+		auto control1 = mirror(from, state.lastControlC);
+		sink.cubicTo(control1, p.control2, to);
+		state.lastControlQ = to;
+		state.lastControlC = p.control2;
+	}
+
+	void segment(Vec2f, Vec2f to, const ArcParams& p) {
+		sink.arcTo(p, to);
+		state.lastControlQ = state.lastControlC = to;
+	}
+
+	void close() {
+		sink.close();
+	}
+};
+
+/// Parser handler that flattens the segments immediately.
+/// Like flatten(const Subpath&), subpaths without segments don't
+/// output any points.
+struct FlattenHandler {
+	using Output = detail::VectorOutput<std::pmr::vector<Vec2f>>;
+
+	FlattenedPath& path;
+	detail::Flattener<Output>& flattener;
+
+	Vec2f start {};
+	bool open {}; // whether there is a subpath
+	bool started {}; // whether the start point was output
+	bool closed {};
+
+	void move(Vec2f to) {
+		finishSubpath();
+		start = to;
+		open = true;
+		started = false;
+		closed = false;
+	}
+
+	template<typename P>
+	void segment(Vec2f, Vec2f to, const P& params) {
+		if(!started) {
+			flattener.start(start);
+			started = true;
+		}
+
+		flattener.segment(to, params);
+	}
+
+	void close() {
+		closed = true;
+	}
+
+	void finishSubpath() {
+		if(!open) {
+			return;
+		}
+
+		if(started) {
+			flattener.finish(closed);
+		}
+
+		path.offsets.push_back(unsigned(path.points.size()));
+		open = false;
+	}
+};
+
+} // anon namespace
+
+const char* scanSvgNumber(const char* begin, const char* end, float& out) {
+	auto it = begin;
+	auto negative = false;
+	if(it != end && (*it == '+' || *it == '-')) {
+		negative = (*it == '-');
+		++it;
+	}
+
+	std::uint64_t mantissa = 0u;
+	int exp = 0;
+	auto digitsEnd = addDigits<false>(it, end, mantissa, exp);
+	auto digits = (digitsEnd != it);
+	it = digitsEnd;
+
+	// a second '.' starts the next number, e.g. "1.5.5"
+	if(it != end && *it == '.') {
 		++it;
-		switch(c) {
-			case 'M': case 'm': {
-				if(first) {
-					current->start = readCoords();
-				} else {
-					if(sub) {
-						auto id = unsigned(it - begin);
-						error = {SvgErrorType::subpathMove, id};
-					} else {
-						ret.subpaths.push_back({readCoords()});
-						current = &ret.subpaths.back();
-					}
+		digitsEnd = addDigits<true>(it, end, mantissa, exp);
+		digits |= (digitsEnd != it);
+		it = digitsEnd;
+	}
+
+	if(!digits) {
+		return begin;
+	}
+
+	// only consume the exponent if it is complete
+	if(it != end && (*it == 'e' || *it == 'E')) {
+		auto eit = it + 1;
+		auto negativeExp = false;
+		if(eit != end && (*eit == '+' || *eit == '-')) {
+			negativeExp = (*eit == '-');
+			++eit;
+		}
+
+		if(eit != end && isDigit(*eit)) {
+			auto value = 0;
+			for(; eit != end && isDigit(*eit); ++eit) {
+				if(value < 100000) {
+					value = 10 * value + (*eit - '0');
 				}
-				break;
-			} case 'L': case 'l': {
-				repeat([&] {
-					auto cmd = Command{readCoords(), LineParams {}};
-					if(c == 'l') {
-						cmd.to += last;
-					}
-					return cmd;
-				});
-				break;
-			} case 'H': case 'h': {
-				repeat([&] {
-					auto cmd = Command{{}, LineParams {}};
-					cmd.to.x = readFloat();
-					cmd.to.y = last.y;
-					if(c == 'h') {
-						cmd.to.x += last.x;
-					}
-					return cmd;
-				});
-				break;
-			} case 'V': case 'v': {
-				repeat([&] {
-					auto cmd = Command{{}, LineParams {}};
-					cmd.to.x = last.x;
-					cmd.to.y = readFloat();
-					if(c == 'v') {
-						cmd.to.y += last.y;
-					}
-					return cmd;
-				});
-				break;
-			} case 'C': case 'c': {
-				repeat([&] {
-					auto cmd = Command{{}, CBezierParams{}};
-					auto& bezier = std::get<CBezierParams>(cmd.params);
-					bezier.control1 = readCoords();
-					skipSpace(); skipComma();
-					bezier.control2 = readCoords();
-					skipSpace(); skipComma();
-					cmd.to = readCoords();
-					if(c == 'c') {
-						bezier.control1 += last;
-						bezier.control2 += last;
-						cmd.to += last;
-					}
-					return cmd;
-				});
-				break;
-			} case 'S': case 's': {
-				repeat([&] {
-					auto cmd = Command{{}, SCBezierParams{}};
-					auto& bezier = std::get<SCBezierParams>(cmd.params);
-					bezier.control2 = readCoords();
-					skipSpace(); skipComma();
-					cmd.to = readCoords();
-					if(c == 's') {
-						bezier.control2 += last;
-						cmd.to += last;
-					}
-					return cmd;
-				});
-				break;
-			} case 'Q': case 'q': {
-				repeat([&] {
-					auto cmd = Command{{}, QBezierParams{}};
-					auto& bezier = std::get<QBezierParams>(cmd.params);
-					bezier.control = readCoords();
-					skipSpace(); skipComma();
-					cmd.to = readCoords();
-					if(c == 'q') {
-						bezier.control += last;
-						cmd.to += last;
-					}
-					return cmd;
-				});
-				break;
-			} case 'T': case 't': {
-				repeat([&] {
-					auto cmd = Command{{}, SQBezierParams{}};
-					cmd.to = readCoords();
-					if(c == 't') {
-						cmd.to += last;
-					}
-					return cmd;
-				});
-				break;
-			} case 'A': case 'a': {
-				repeat([&] {
-					auto cmd = Command{{}, ArcParams {}};
-					auto& arc = std::get<ArcParams>(cmd.params);
-					arc.radius = readCoords();
-
-					skipSpace(); skipComma();
-					readFloat(); // TODO: axis rotation
-
-					skipSpace(); skipComma();
-					arc.largeArc = readFloat();
-
-					skipSpace(); skipComma();
-					arc.clockwise = readFloat();
-
-					skipSpace(); skipComma();
-					cmd.to = readCoords();
-					if(c == 'a') {
-						cmd.to += last;
-					}
-					return cmd;
-				});
-				break;
-			} case 'Z': case 'z': {
-				current->closed = true;
-				break;
-			} default: {
-				auto pos = unsigned(it - begin) - 1;
-				error = {SvgErrorType::invalidCommand, pos};
-				return {};
 			}
-		}
 
-		first = false;
-		if(error) {
-			return {};
+			exp += negativeExp ? -value : value;
+			it = eit;
 		}
 	}
 
-	return ret;
-}
+	// When both mantissa and power of ten are exactly representable,
+	// a single multiplication/division is correctly rounded.
+	double value;
+	if(mantissa == 0u) {
+		value = 0.0;
+	} else if(mantissa <= (std::uint64_t(1) << 53) && exp >= -22 && exp <= 22) {
+		value = exp < 0 ?
+			double(mantissa) / exactPow10[-exp] :
+			double(mantissa) * exactPow10[exp];
+	} else {
+		value = double(mantissa) * std::pow(10.0, exp);
+	}
 
-} // anon namespace
+	out = float(negative ? -value : value);
+	return it;
+}
 
 SvgException::SvgException(const SvgError& err) :
 	std::invalid_argument(description(err)) {
@@ -280,6 +714,8 @@ std::string description(const SvgError& err) {
 				return "Invalid svg path command";
 			case SvgErrorType::invalidNumber:
 				return "Invalid number parameter";
+			case SvgErrorType::incomplete:
+				return "Incomplete command";
 			default:
 				return "<Invalid error type>";
 		}
@@ -292,7 +728,7 @@ std::string description(const SvgError& err) {
 	return str;
 }
 
-Subpath parseSvgSubpath(StringParam svgSubpath, Vec2f start) {
+Subpath parseSvgSubpath(std::string_view svgSubpath, Vec2f start) {
 	std::optional<SvgError> error;
 	auto ret = parseSvgSubpath(svgSubpath, error, start);
 	if(error) {
@@ -301,14 +737,26 @@ Subpath parseSvgSubpath(StringParam svgSubpath, Vec2f start) {
 	return ret;
 }
 
-Subpath parseSvgSubpath(StringParam svgSubpath, std::optional<SvgError>& error,
-		nytl::Vec2f start) {
-	Subpath subpath;
-	parseSvgPath(svgSubpath, error, start, &subpath);
+Subpath parseSvgSubpath(std::string_view svgSubpath,
+		std::optional<SvgError>& error, nytl::Vec2f start) {
+	error.reset();
+
+	Subpath subpath {start};
+	PathBuilder builder {nullptr, &subpath};
+	detail::SvgParserState state;
+	state.current = start;
+
+	auto end = svgSubpath.data() + svgSubpath.size();
+	Parser<PathBuilder> parser(state, builder, true);
+	parser.parse(svgSubpath.data(), end, true, error);
+	if(error) {
+		return {};
+	}
+
 	return subpath;
 }
 
-Path parseSvgPath(StringParam svgPath, Vec2f start) {
+Path parseSvgPath(std::string_view svgPath, Vec2f start) {
 	std::optional<SvgError> error;
 	auto ret = parseSvgPath(svgPath, error, start);
 	if(error) {
@@ -317,9 +765,122 @@ Path parseSvgPath(StringParam svgPath, Vec2f start) {
 	return ret;
 }
 
-Path parseSvgPath(StringParam svgPath, std::optional<SvgError>& error,
+Path parseSvgPath(std::string_view svgPath, std::optional<SvgError>& error,
 		Vec2f start) {
-	return parseSvgPath(svgPath, error, start, nullptr);
+	error.reset();
+
+	Path path;
+	path.subpaths.emplace_back(start);
+	PathBuilder builder {&path, &path.subpaths.back()};
+	detail::SvgParserState state;
+	state.current = start;
+
+	auto end = svgPath.data() + svgPath.size();
+	Parser<PathBuilder> parser(state, builder, false);
+	parser.parse(svgPath.data(), end, true, error);
+	if(error) {
+		return {};
+	}
+
+	return path;
+}
+
+std::optional<SvgError> visitSvgPath(std::string_view svgPath,
+		SvgPathSink& sink, Vec2f start) {
+	std::optional<SvgError> error;
+	detail::SvgParserState state;
+	state.current = start;
+
+	SinkHandler handler {sink, state};
+	auto end = svgPath.data() + svgPath.size();
+	Parser<SinkHandler> parser(state, handler, false);
+	parser.parse(svgPath.data(), end, true, error);
+	return error;
+}
+
+std::optional<SvgError> flattenSvgPath(std::string_view svgPath,
+		FlattenedPath& out, const FlattenSettings& fs,
+		const Transform& transform) {
+	out.points.clear();
+	out.offsets.clear();
+	out.offsets.push_back(0u);
+
+	FlattenHandler::Output output {out.points};
+	detail::Flattener<FlattenHandler::Output> flattener(fs, transform, output);
+	FlattenHandler handler {out, flattener};
+
+	std::optional<SvgError> error;
+	detail::SvgParserState state;
+	auto end = svgPath.data() + svgPath.size();
+	Parser<FlattenHandler> parser(state, handler, false);
+	parser.parse(svgPath.data(), end, true, error);
+	if(error) {
+		out.points.clear();
+		out.offsets.clear();
+		return error;
+	}
+
+	handler.finishSubpath();
+	return std::nullopt;
+}
+
+FlattenedPath flattenSvgPath(std::string_view svgPath,
+		const FlattenSettings& fs, const Transform& transform) {
+	FlattenedPath ret;
+	auto error = flattenSvgPath(svgPath, ret, fs, transform);
+	if(error) {
+		throw SvgException(error.value());
+	}
+
+	return ret;
+}
+
+// SvgPathStream
+SvgPathStream::SvgPathStream(SvgPathSink& sink, Vec2f start) : sink_(&sink) {
+	state_.current = start;
+}
+
+std::size_t SvgPathStream::parse(std::string_view input, bool final) {
+	SinkHandler handler {*sink_, state_};
+	Parser<SinkHandler> parser(state_, handler, false);
+	auto end = input.data() + input.size();
+	auto consumed = std::size_t(parser.parse(input.data(), end, final, error_) -
+		input.data());
+	state_.offset += unsigned(consumed);
+	return consumed;
+}
+
+bool SvgPathStream::feed(std::string_view chunk) {
+	if(error_) {
+		return false;
+	}
+
+	dlg_assert(!finished_);
+
+	// common case: nothing is pending, parse the chunk in place
+	// and only store its incomplete tail
+	if(pending_.empty()) {
+		auto consumed = parse(chunk, false);
+		pending_.assign(chunk.data() + consumed, chunk.size() - consumed);
+	} else {
+		pending_.append(chunk);
+		auto consumed = parse(pending_, false);
+		pending_.erase(0, consumed);
+	}
+
+	return !error_;
+}
+
+bool SvgPathStream::finish() {
+	if(error_) {
+		return false;
+	}
+
+	dlg_assert(!finished_);
+	finished_ = true;
+	parse(pending_, true);
+	pending_.clear();
+	return !error_;
 }
 
 } // namespace ktc
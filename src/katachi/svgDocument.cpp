@@ -0,0 +1,344 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+#include "scan.hpp"
+#include <katachi/svgDocument.hpp>
+#include <katachi/mappedFile.hpp>
+#include <dlg/dlg.hpp>
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace ktc {
+namespace {
+
+using detail::isSpace;
+using detail::find;
+
+constexpr auto maxAttributes = 6u;
+
+// The geometry attributes of the different element types, the
+// values are stored in the same order in RawElement.
+constexpr std::string_view attributeNames[][maxAttributes] = {
+	{"d"}, // path
+	{"x", "y", "width", "height", "rx", "ry"}, // rect
+	{"cx", "cy", "r"}, // circle
+	{"cx", "cy", "rx", "ry"}, // ellipse
+	{"x1", "y1", "x2", "y2"}, // line
+	{"points"}, // polyline
+	{"points"}, // polygon
+};
+
+constexpr std::pair<std::string_view, SvgElementType> elementNames[] = {
+	{"path", SvgElementType::path},
+	{"rect", SvgElementType::rect},
+	{"circle", SvgElementType::circle},
+	{"ellipse", SvgElementType::ellipse},
+	{"line", SvgElementType::line},
+	{"polyline", SvgElementType::polyline},
+	{"polygon", SvgElementType::polygon},
+};
+
+/// Element found while scanning the document.
+/// All strings point into the document.
+struct RawElement {
+	SvgElementType type;
+	std::string_view id;
+	std::array<std::optional<std::string_view>, maxAttributes> attributes;
+};
+
+/// Returns the end of the first occurrence of str in [it, end) or end.
+const char* skipPast(const char* it, const char* end, std::string_view str) {
+	while((it = find(it, end, str[0])) != end) {
+		if(std::size_t(end - it) >= str.size() &&
+				std::memcmp(it, str.data(), str.size()) == 0) {
+			return it + str.size();
+		}
+		++it;
+	}
+
+	return end;
+}
+
+/// Reads the attributes of an element starting at it until the end
+/// of the tag. Returns the end of the tag and false for malformed tags.
+bool readAttributes(const char*& it, const char* end, RawElement& elem) {
+	auto& names = attributeNames[unsigned(elem.type)];
+	while(true) {
+		while(it != end && isSpace(*it)) {
+			++it;
+		}
+
+		if(it == end) {
+			return false;
+		} else if(*it == '>' || *it == '/') {
+			++it;
+			return true;
+		}
+
+		auto nameBegin = it;
+		while(it != end && *it != '=' && !isSpace(*it) && *it != '>') {
+			++it;
+		}
+
+		auto name = std::string_view(nameBegin, std::size_t(it - nameBegin));
+		while(it != end && isSpace(*it)) {
+			++it;
+		}
+
+		if(it == end || *it != '=') {
+			return false;
+		}
+
+		++it;
+		while(it != end && isSpace(*it)) {
+			++it;
+		}
+
+		if(it == end || (*it != '"' && *it != '\'')) {
+			return false;
+		}
+
+		auto valueBegin = it + 1;
+		it = find(valueBegin, end, *it);
+		if(it == end) {
+			return false;
+		}
+
+		auto value = std::string_view(valueBegin, std::size_t(it - valueBegin));
+		++it;
+
+		if(name == "id") {
+			elem.id = value;
+			continue;
+		}
+
+		for(auto i = 0u; i < maxAttributes; ++i) {
+			if(!names[i].empty() && names[i] == name) {
+				elem.attributes[i] = value;
+				break;
+			}
+		}
+	}
+}
+
+/// Finds all shape elements in the given document.
+std::vector<RawElement> scan(std::string_view document) {
+	std::vector<RawElement> ret;
+	auto it = document.data();
+	auto end = it + document.size();
+
+	while((it = find(it, end, '<')) != end) {
+		++it;
+		if(it == end) {
+			break;
+		}
+
+		// comments, cdata, declarations, processing instructions, end tags
+		if(*it == '!') {
+			if(end - it >= 3 && it[1] == '-' && it[2] == '-') {
+				it = skipPast(it, end, "-->");
+			} else if(end - it >= 8 && std::memcmp(it, "![CDATA[", 8) == 0) {
+				it = skipPast(it, end, "]]>");
+			}
+			continue;
+		} else if(*it == '?' || *it == '/') {
+			continue;
+		}
+
+		auto nameBegin = it;
+		while(it != end && !isSpace(*it) && *it != '/' && *it != '>') {
+			++it;
+		}
+
+		auto name = std::string_view(nameBegin, std::size_t(it - nameBegin));
+		if(auto colon = name.find(':'); colon != name.npos) {
+			name.remove_prefix(colon + 1); // namespace prefix
+		}
+
+		auto type = std::find_if(std::begin(elementNames),
+			std::end(elementNames), [&](auto& e) { return e.first == name; });
+		if(type == std::end(elementNames)) {
+			continue;
+		}
+
+		RawElement elem {type->second, {}, {}};
+		if(readAttributes(it, end, elem)) {
+			ret.push_back(elem);
+		} else {
+			dlg_debug("loadSvgDocument: malformed <{}> tag", name);
+		}
+	}
+
+	return ret;
+}
+
+/// Reads a number attribute, ignoring units. Returns fallback
+/// if there is no attribute or it is not a number.
+float number(const std::optional<std::string_view>& attrib,
+		float fallback = 0.f) {
+	if(!attrib) {
+		return fallback;
+	}
+
+	auto it = attrib->data();
+	auto end = it + attrib->size();
+	while(it != end && isSpace(*it)) {
+		++it;
+	}
+
+	float ret;
+	return scanSvgNumber(it, end, ret) == it ? fallback : ret;
+}
+
+// Appends two arcs forming the ellipse with the given center and radius.
+void ellipse(Path& path, Vec2f center, Vec2f radius) {
+	auto& sub = path.move({center.x + radius.x, center.y});
+	sub.arc({center.x - radius.x, center.y}, {radius, false, true});
+	sub.arc({center.x + radius.x, center.y}, {radius, false, true});
+	sub.closed = true;
+}
+
+// See https://www.w3.org/TR/SVG11/shapes.html for the equivalent
+// paths of all basic shapes.
+SvgElement build(const RawElement& raw) {
+	SvgElement ret {raw.type, std::string(raw.id), {}, {}};
+	auto& a = raw.attributes;
+
+	switch(raw.type) {
+		case SvgElementType::path: {
+			if(a[0]) {
+				ret.path = parseSvgPath(*a[0], ret.error);
+			}
+			break;
+		} case SvgElementType::rect: {
+			auto pos = Vec2f {number(a[0]), number(a[1])};
+			auto size = Vec2f {number(a[2]), number(a[3])};
+			if(size.x <= 0.f || size.y <= 0.f) {
+				break;
+			}
+
+			// if only one radius is given, it is used for both
+			auto rx = number(a[4], -1.f);
+			auto ry = number(a[5], -1.f);
+			rx = (rx < 0.f) ? std::max(ry, 0.f) : rx;
+			ry = (ry < 0.f) ? rx : ry;
+			rx = std::min(rx, 0.5f * size.x);
+			ry = std::min(ry, 0.5f * size.y);
+
+			auto end = pos + size;
+			if(rx == 0.f || ry == 0.f) {
+				auto& sub = ret.path.move(pos);
+				sub.line({end.x, pos.y});
+				sub.line(end);
+				sub.line({pos.x, end.y});
+				sub.closed = true;
+				break;
+			}
+
+			auto arc = ArcParams {{rx, ry}, false, true};
+			auto& sub = ret.path.move({pos.x + rx, pos.y});
+			sub.line({end.x - rx, pos.y});
+			sub.arc({end.x, pos.y + ry}, arc);
+			sub.line({end.x, end.y - ry});
+			sub.arc({end.x - rx, end.y}, arc);
+			sub.line({pos.x + rx, end.y});
+			sub.arc({pos.x, end.y - ry}, arc);
+			sub.line({pos.x, pos.y + ry});
+			sub.arc({pos.x + rx, pos.y}, arc);
+			sub.closed = true;
+			break;
+		} case SvgElementType::circle: {
+			auto r = number(a[2]);
+			if(r > 0.f) {
+				ellipse(ret.path, {number(a[0]), number(a[1])}, {r, r});
+			}
+			break;
+		} case SvgElementType::ellipse: {
+			auto radius = Vec2f {number(a[2]), number(a[3])};
+			if(radius.x > 0.f && radius.y > 0.f) {
+				ellipse(ret.path, {number(a[0]), number(a[1])}, radius);
+			}
+			break;
+		} case SvgElementType::line: {
+			auto& sub = ret.path.move({number(a[0]), number(a[1])});
+			sub.line({number(a[2]), number(a[3])});
+			break;
+		} case SvgElementType::polyline:
+		case SvgElementType::polygon: {
+			if(!a[0]) {
+				break;
+			}
+
+			// a list of coordinates, separated by whitespace and commas
+			// an odd coordinate at the end is ignored
+			auto it = a[0]->data();
+			auto end = it + a[0]->size();
+			auto skip = [&]{
+				while(it != end && (isSpace(*it) || *it == ',')) {
+					++it;
+				}
+			};
+
+			Subpath* sub = nullptr;
+			while(true) {
+				Vec2f p;
+				skip();
+				auto next = scanSvgNumber(it, end, p.x);
+				if(next == it) {
+					break;
+				}
+
+				it = next;
+				skip();
+				next = scanSvgNumber(it, end, p.y);
+				if(next == it) {
+					break;
+				}
+
+				it = next;
+				if(!sub) {
+					sub = &ret.path.move(p);
+				} else {
+					sub->line(p);
+				}
+			}
+
+			if(sub && raw.type == SvgElementType::polygon) {
+				sub->closed = true;
+			}
+			break;
+		}
+	}
+
+	return ret;
+}
+
+} // anon namespace
+
+std::vector<SvgElement> loadSvgDocument(std::string_view document,
+		const ParallelForFn& parallelFor) {
+	auto raw = scan(document);
+	auto count = unsigned(raw.size());
+
+	std::vector<SvgElement> ret(count);
+	auto job = [&](unsigned i) { ret[i] = build(raw[i]); };
+	if(parallelFor) {
+		parallelFor(count, job);
+	} else {
+		for(auto i = 0u; i < count; ++i) {
+			job(i);
+		}
+	}
+
+	return ret;
+}
+
+std::vector<SvgElement> loadSvgFile(const char* filename,
+		const ParallelForFn& parallelFor) {
+	MappedFile file(filename);
+	return loadSvgDocument(file.view(), parallelFor);
+}
+
+} // namespace ktc
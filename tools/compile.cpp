@@ -0,0 +1,61 @@
+// Copyright (c) 2018-2020 Jan Kelling
+// Distributed under the Boost Software License, Version 1.0.
+// See accompanying file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt
+
+// Compiles svg files and path strings into the binary path format
+// (katachi/binaryPath.hpp) that can be loaded at runtime without parsing.
+// Usage: ktc-compile <output> [<file.svg> | -d <path data>]...
+// Paths from svg files are named by their id attribute, paths given
+// with -d are named by their index on the command line.
+
+#include <katachi/binaryPath.hpp>
+#include <katachi/svgDocument.hpp>
+#include <katachi/svg.hpp>
+#include <katachi/parallel.hpp>
+#include <cstdio>
+#include <exception>
+#include <string>
+
+int main(int argc, char** argv) {
+	if(argc < 3) {
+		std::fprintf(stderr,
+			"Usage: %s <output> [<file.svg> | -d <path data>]...\n", argv[0]);
+		return 1;
+	}
+
+	ktc::ThreadPool pool;
+	ktc::BinaryPathWriter writer;
+	try {
+		for(auto i = 2; i < argc; ++i) {
+			std::string arg = argv[i];
+			if(arg == "-d") {
+				if(++i == argc) {
+					std::fprintf(stderr, "Missing path data after -d\n");
+					return 1;
+				}
+
+				auto name = std::to_string(writer.size());
+				writer.add(ktc::parseSvgPath(argv[i]), name);
+				continue;
+			}
+
+			auto elements = ktc::loadSvgFile(argv[i], pool.executor());
+			for(auto& elem : elements) {
+				if(elem.error) {
+					std::fprintf(stderr, "%s: skipping '%s': %s\n", argv[i],
+						elem.id.c_str(), ktc::description(*elem.error).c_str());
+					continue;
+				}
+
+				writer.add(elem.path, elem.id);
+			}
+		}
+
+		writer.write(argv[1]);
+	} catch(const std::exception& err) {
+		std::fprintf(stderr, "%s\n", err.what());
+		return 1;
+	}
+
+	std::printf("Wrote %u paths to %s\n", writer.size(), argv[1]);
+}